@@ -0,0 +1,21 @@
+#!/bin/bash
+# Measures the cost of checked mode (TIL_CHECKED=1) on array kernels.
+#
+#   bench/checked_overhead.sh [program.til]
+#
+# ROOT must point to the CDK/RTS installation, as in the Makefile.
+set -e
+
+SOURCE=${1:-bench/checked_arrays.til}
+. "$(dirname "$0")/common.sh"
+
+build unchecked "$SOURCE"
+build checked "$SOURCE" "TIL_CHECKED=1"
+
+[ "$("$WORK/unchecked")" = "$("$WORK/checked")" ] || { echo "outputs differ"; exit 1; }
+
+unchecked=$(run unchecked)
+checked=$(run checked)
+echo "unchecked: ${unchecked}s"
+echo "checked:   ${checked}s"
+echo "overhead:  $(echo "scale=1; 100 * ($checked - $unchecked) / $unchecked" | bc)%"
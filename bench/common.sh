@@ -0,0 +1,26 @@
+#!/bin/bash
+# Helpers shared by the benchmark scripts, which source this file.
+#
+# ROOT must point to the CDK/RTS installation, as in the Makefile.
+
+ROOT=${ROOT:-${HOME}/compiladores/root}
+TIL=${TIL:-./til}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+build() { # name, program, extra environment
+  env $3 "$TIL" --target asm -o "$WORK/$1.asm" "$2"
+  yasm -felf32 -o "$WORK/$1.o" "$WORK/$1.asm"
+  ld -m elf_i386 -o "$WORK/$1" "$WORK/$1.o" -L"$ROOT/usr/lib" -lrts
+}
+
+run() { # name, extra environment: best of 5, in seconds
+  local best=
+  for _ in 1 2 3 4 5; do
+    local start=$(date +%s.%N)
+    env $2 "$WORK/$1" > /dev/null
+    local elapsed=$(echo "$(date +%s.%N) - $start" | bc)
+    if [ -z "$best" ] || [ "$(echo "$elapsed < $best" | bc)" = 1 ]; then best=$elapsed; fi
+  done
+  echo "$best"
+}
@@ -0,0 +1,24 @@
+#!/bin/bash
+# Measures how parallel loops scale from 1 to N threads: the program is
+# built once (TIL_MAX_THREADS=N) and run with TIL_THREADS=1..N.
+#
+#   bench/parallel_scaling.sh [program.til] [N]
+#
+# N defaults to the number of cores. ROOT must point to the CDK/RTS
+# installation, as in the Makefile.
+set -e
+
+SOURCE=${1:-bench/parallel_map.til}
+MAX=${2:-$(nproc)}
+. "$(dirname "$0")/common.sh"
+
+build serial "$SOURCE" "TIL_MAX_THREADS=1"
+build parallel "$SOURCE" "TIL_MAX_THREADS=$MAX"
+serial=$(run serial "TIL_THREADS=1")
+echo "serial:    ${serial}s"
+
+for ((threads = 1; threads <= MAX; threads++)); do
+  [ "$("$WORK/serial")" = "$(TIL_THREADS=$threads "$WORK/parallel")" ] || { echo "outputs differ with $threads threads"; exit 1; }
+  elapsed=$(run parallel "TIL_THREADS=$threads")
+  echo "threads $threads: ${elapsed}s (speedup $(echo "scale=2; $serial / $elapsed" | bc))"
+done
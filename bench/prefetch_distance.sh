@@ -0,0 +1,26 @@
+#!/bin/bash
+# Measures software prefetching (TIL_PREFETCH_DISTANCE) on gathers from
+# arrays larger than the last-level cache.
+#
+#   bench/prefetch_distance.sh [program.til] [distance...]
+#
+# The distances default to 8 16 32 64; distance 0 (no prefetching) is the
+# baseline.
+#
+# ROOT must point to the CDK/RTS installation, as in the Makefile.
+set -e
+
+SOURCE=${1:-bench/gather.til}
+. "$(dirname "$0")/common.sh"
+
+build d0 "$SOURCE" "TIL_PREFETCH_DISTANCE=0"
+baseline=$(run d0)
+echo "distance 0: ${baseline}s"
+
+shift || true
+for distance in ${@:-8 16 32 64}; do
+  build "d$distance" "$SOURCE" "TIL_PREFETCH_DISTANCE=$distance"
+  [ "$("$WORK/d0")" = "$("$WORK/d$distance")" ] || { echo "outputs differ with distance $distance"; exit 1; }
+  elapsed=$(run "d$distance")
+  echo "distance $distance: ${elapsed}s (speedup $(echo "scale=2; $baseline / $elapsed" | bc))"
+done
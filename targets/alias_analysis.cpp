@@ -0,0 +1,140 @@
+#include "targets/alias_analysis.h"
+#include ".auto/all_nodes.h"
+#include "til_parser.tab.h"
+
+std::string til::alias_analysis::access::key() const {
+  if (!indexed) {
+    return variable;
+  }
+  return variable + "[" + (literalIndex ? std::to_string(*literalIndex) : variableIndex ? "$" + *variableIndex : "?") + "]";
+}
+
+std::optional<til::alias_analysis::access> til::alias_analysis::describe(cdk::lvalue_node *lvalue) const {
+  if (auto var = dynamic_cast<cdk::variable_node*>(lvalue)) {
+    return describeVariable(var->name());
+  }
+
+  auto index = dynamic_cast<til::index_node*>(lvalue);
+  auto element = index ? describeElement(index) : std::nullopt;
+  if (!element || (!element->literalIndex && !element->variableIndex)) {
+    return std::nullopt;
+  }
+  return element;
+}
+
+std::optional<til::alias_analysis::access> til::alias_analysis::describeVariable(const std::string &name) const {
+  access result;
+  result.variable = name;
+  result.symbol = _symtab.find(name);
+  if (result.symbol == nullptr) {
+    return std::nullopt;
+  }
+  result.type = result.symbol->type();
+  return result;
+}
+
+std::optional<til::alias_analysis::access> til::alias_analysis::describeElement(til::index_node *index) const {
+  access result;
+  auto array = counted_loop::readVariable(index->pointer());
+  if (!array) {
+    return std::nullopt;
+  }
+  result.variable = *array;
+  result.indexed = true;
+  result.symbol = _symtab.find(*array);
+  if (result.symbol == nullptr || !result.symbol->is_typed(cdk::TYPE_POINTER)) {
+    return std::nullopt;
+  }
+
+  if (auto literal = dynamic_cast<cdk::integer_node*>(index->index())) {
+    result.literalIndex = literal->value();
+  } else if (auto name = counted_loop::readVariable(index->index())) {
+    result.variableIndex = name;
+  }
+
+  auto referenced = cdk::reference_type::cast(result.symbol->type())->referenced();
+  if (referenced->name() != cdk::TYPE_UNSPEC) {
+    result.type = referenced;
+  }
+  return result;
+}
+
+bool til::alias_analysis::addressTaken(const std::shared_ptr<til::symbol> &symbol) const {
+  if (!symbol->global()) {
+    return _addressTaken.count(symbol->name()) > 0;
+  }
+  // other modules may point to the globals they see
+  return symbol->qualifier() != tPRIVATE || _moduleAddressTaken.count(symbol->name()) > 0;
+}
+
+bool til::alias_analysis::mayAlias(const access &load, const access &store) const {
+  // an element of one type is never changed through another type
+  bool sameType = load.type == nullptr || store.type == nullptr || load.type->name() == store.type->name();
+
+  if (!load.indexed && !store.indexed) {
+    return load.symbol == store.symbol;
+  } else if (!load.indexed) {
+    return sameType && addressTaken(load.symbol);
+  } else if (!store.indexed) {
+    return sameType && addressTaken(store.symbol);
+  } else if (!sameType) {
+    return false;
+  }
+
+  if (load.symbol == store.symbol) {
+    return !(load.literalIndex && store.literalIndex && *load.literalIndex != *store.literalIndex);
+  }
+
+  auto loadSite = _allocationSites.find(load.symbol.get());
+  auto storeSite = _allocationSites.find(store.symbol.get());
+  return loadSite == _allocationSites.end() || storeSite == _allocationSites.end() || loadSite->second == storeSite->second;
+}
+
+/*
+ * Collects the loads an expression always evaluates.
+*/
+static void alwaysEvaluated(cdk::expression_node *expression, std::vector<cdk::rvalue_node*> &loads) {
+  if (auto rvalue = dynamic_cast<cdk::rvalue_node*>(expression)) {
+    loads.push_back(rvalue);
+    if (auto index = dynamic_cast<til::index_node*>(rvalue->lvalue())) {
+      alwaysEvaluated(index->pointer(), loads);
+      alwaysEvaluated(index->index(), loads);
+    }
+  } else if (auto assignment = dynamic_cast<cdk::assignment_node*>(expression)) {
+    alwaysEvaluated(assignment->rvalue(), loads);
+    if (auto index = dynamic_cast<til::index_node*>(assignment->lvalue())) {
+      alwaysEvaluated(index->pointer(), loads);
+      alwaysEvaluated(index->index(), loads);
+    }
+  } else if (auto logical = dynamic_cast<cdk::and_node*>(expression)) {
+    alwaysEvaluated(logical->left(), loads);
+  } else if (auto logical = dynamic_cast<cdk::or_node*>(expression)) {
+    alwaysEvaluated(logical->left(), loads);
+  } else if (auto binary = dynamic_cast<cdk::binary_operation_node*>(expression)) {
+    alwaysEvaluated(binary->left(), loads);
+    alwaysEvaluated(binary->right(), loads);
+  } else if (auto unary = dynamic_cast<cdk::unary_operation_node*>(expression)) {
+    alwaysEvaluated(unary->argument(), loads);
+  }
+}
+
+std::vector<cdk::rvalue_node*> til::alias_analysis::everyIteration(til::loop_node *node) {
+  std::vector<cdk::rvalue_node*> loads;
+  alwaysEvaluated(node->condition(), loads);
+
+  auto block = dynamic_cast<til::block_node*>(node->block());
+  if (block == nullptr) {
+    if (auto evaluation = dynamic_cast<til::evaluation_node*>(node->block())) {
+      alwaysEvaluated(evaluation->argument(), loads);
+    }
+    return loads;
+  }
+  for (size_t i = 0; i < block->instructions()->size(); i++) {
+    auto evaluation = dynamic_cast<til::evaluation_node*>(block->instructions()->node(i));
+    if (evaluation == nullptr) {
+      break;
+    }
+    alwaysEvaluated(evaluation->argument(), loads);
+  }
+  return loads;
+}
@@ -0,0 +1,88 @@
+#ifndef __TIL_TARGETS_ALIAS_ANALYSIS_H__
+#define __TIL_TARGETS_ALIAS_ANALYSIS_H__
+
+#include <map>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+#include "targets/counted_loop.h"
+
+namespace til {
+
+  /**
+   * Decides whether a store may change the memory a load reads, for
+   * accesses of the form v (a variable) or (index a k) (an array variable
+   * a, with a literal or variable index k). It relies on these rules:
+   *
+   *   - distinct variables never overlap, and only a variable whose
+   *     address is taken with ? can be reached through a pointer (or a
+   *     global other modules see, which they may point to);
+   *   - an element is only accessed through its own type: a store through
+   *     int! does not change doubles or pointers (programs that pun types
+   *     through untyped pointers are not supported);
+   *   - arrays from distinct allocation sites (variables initialized by
+   *     objects and never assigned again) never overlap, and neither do
+   *     distinct literal indices of one array.
+   *
+   * Anything else may alias.
+   */
+  class alias_analysis {
+  public:
+    /** A memory access, as far as aliasing is concerned. */
+    struct access {
+      std::string variable; // the scalar, or the array variable
+      bool indexed = false;
+      std::optional<int> literalIndex;
+      std::optional<std::string> variableIndex;
+      std::shared_ptr<til::symbol> symbol; // of variable
+      std::shared_ptr<cdk::basic_type> type; // of the accessed value (unknown if null)
+
+      /** Identifies accesses to the same location. */
+      std::string key() const;
+    };
+
+  private:
+    cdk::symbol_table<til::symbol> &_symtab;
+    const std::set<std::string> &_addressTaken; // locals of the current function used with ?
+    const std::set<std::string> &_moduleAddressTaken; // variables used with ? anywhere
+    const std::map<til::symbol*, til::alloc_node*> &_allocationSites;
+
+  public:
+    alias_analysis(cdk::symbol_table<til::symbol> &symtab, const std::set<std::string> &addressTaken,
+                   const std::set<std::string> &moduleAddressTaken,
+                   const std::map<til::symbol*, til::alloc_node*> &allocationSites) :
+        _symtab(symtab), _addressTaken(addressTaken), _moduleAddressTaken(moduleAddressTaken),
+        _allocationSites(allocationSites) {
+    }
+
+  public:
+    /** Describes an lvalue in the current scope (nothing if it is not a supported access). */
+    std::optional<access> describe(cdk::lvalue_node *lvalue) const;
+
+    /** Describes a variable of the current scope (nothing if it is not declared). */
+    std::optional<access> describeVariable(const std::string &name) const;
+
+    /** Describes an element of an array variable, leaving other indices unknown (may alias any). */
+    std::optional<access> describeElement(til::index_node *index) const;
+
+    /** True if storing to store may change what load reads. */
+    bool mayAlias(const access &load, const access &store) const;
+
+    /** True if a pointer may lead to the variable (always, for globals that are not private). */
+    bool addressTaken(const std::shared_ptr<til::symbol> &symbol) const;
+
+    /**
+     * Loads of the loop that run in every iteration in which the loop body
+     * starts: those in the left-most operand chain of the condition and in
+     * the leading evaluation instructions of the body (up to the first
+     * instruction that may transfer control). Right operands of and/or are
+     * skipped, as they may not run.
+     */
+    static std::vector<cdk::rvalue_node*> everyIteration(til::loop_node *node);
+
+  };
+
+} // til
+
+#endif
@@ -0,0 +1,202 @@
+#include <optional>
+#include <sstream>
+#include <unordered_map>
+#include "targets/code_folder.h"
+#include "targets/jump_threader.h"
+
+til::code_folder::code_folder(const std::string &assembly) {
+  std::istringstream input(assembly);
+  for (std::string text; std::getline(input, text);) {
+    _lines.push_back(text);
+  }
+}
+
+/*
+ * Finds the functions: a text section whose first statement defines a
+ * generated label and whose last one is a ret or a jump.
+*/
+void til::code_folder::split() {
+  std::optional<function> current;
+  bool started = false; // the section's first statement was seen (or it is not code)
+  std::string last; // mnemonic of the current function's last instruction
+
+  auto close = [&](size_t end) {
+    if (current && (last == "ret" || last == "retn" || last == "jmp")) {
+      current->end = end;
+      _functions.push_back(*current);
+    }
+    current.reset();
+  };
+
+  for (size_t k = 0; k < _lines.size(); k++) {
+    auto body = jump_threader::statement(_lines[k]);
+    auto words = jump_threader::tokens(body);
+    if (words.empty()) {
+      continue;
+    }
+
+    std::smatch match;
+    bool definition = std::regex_match(body, match, jump_threader::labelDefinition);
+    if (!definition) {
+      for (std::sregex_iterator it(body.begin(), body.end(), jump_threader::identifier), end; it != end; ++it) {
+        if (std::regex_match(it->str(), jump_threader::generatedLabel)) _uses[it->str()].push_back(k);
+      }
+    }
+
+    if (auto textSection = jump_threader::section(words)) {
+      close(k);
+      started = !*textSection;
+      last.clear();
+      if (!started) {
+        current = function{ k, 0, 0, "", {} };
+      }
+    } else if (definition) {
+      if (current && !started) {
+        current->entry = k;
+        current->label = match[1];
+        if (!std::regex_match(current->label, jump_threader::generatedLabel)) current.reset();
+      }
+      if (current) current->labels.insert(match[1]);
+      started = true;
+    } else if (words[0] != "align" && words[0] != "alignb") {
+      if (!started) current.reset();
+      started = true;
+      last = words[0];
+    }
+  }
+  close(_lines.size());
+}
+
+/*
+ * Finds the generated labels that may reach other modules: those in the
+ * data of public symbols and, when there are any such symbols (other than
+ * _main), those used as values (not just called or jumped to) by code,
+ * which may store them in public variables or return them.
+*/
+void til::code_folder::findEscaping() {
+  std::set<std::string> publicNames;
+  for (auto &text : _lines) {
+    auto words = jump_threader::tokens(jump_threader::statement(text));
+    if (words.size() > 1 && words[0] == "global") {
+      auto name = words[1].substr(0, words[1].find(':'));
+      if (name != "_main") publicNames.insert(name);
+    }
+  }
+
+  bool code = true, publicData = false;
+  for (auto &text : _lines) {
+    auto body = jump_threader::statement(text);
+    auto words = jump_threader::tokens(body);
+    std::smatch match;
+    if (words.empty() || words[0] == "global" || words[0] == "extern") {
+      continue;
+    } else if (auto textSection = jump_threader::section(words)) {
+      code = *textSection;
+      publicData = false;
+      continue;
+    } else if (std::regex_match(body, match, jump_threader::labelDefinition)) {
+      if (!code) publicData = publicNames.count(match[1]) > 0;
+      continue;
+    }
+
+    bool value = code ? !publicNames.empty() && words[0] != "call" && words[0][0] != 'j' : publicData;
+    if (value) {
+      for (std::sregex_iterator it(body.begin(), body.end(), jump_threader::identifier), end; it != end; ++it) {
+        if (std::regex_match(it->str(), jump_threader::generatedLabel)) _escaping.insert(it->str());
+      }
+    }
+  }
+}
+
+/*
+ * True if the labels a function defines, other than its own, are only used
+ * inside it (so it can be dropped or shared as a whole).
+*/
+bool til::code_folder::selfContained(const function &candidate) const {
+  for (auto &label : candidate.labels) {
+    auto uses = _uses.find(label);
+    if (label == candidate.label || uses == _uses.end()) {
+      continue;
+    }
+    for (auto k : uses->second) {
+      if (k < candidate.begin || k >= candidate.end) return false;
+    }
+  }
+  return true;
+}
+
+/*
+ * The code of a function, with its own labels numbered in order of definition.
+*/
+std::string til::code_folder::canonical(const function &candidate) const {
+  std::map<std::string, size_t> numbers;
+  for (size_t k = candidate.entry; k < candidate.end; k++) {
+    std::smatch match;
+    auto body = jump_threader::statement(_lines[k]);
+    if (std::regex_match(body, match, jump_threader::labelDefinition)) {
+      numbers.emplace(match[1], numbers.size());
+    }
+  }
+
+  std::string result;
+  for (size_t k = candidate.entry; k < candidate.end; k++) {
+    auto body = jump_threader::statement(_lines[k]);
+    if (body.empty()) {
+      continue;
+    }
+    size_t copied = 0;
+    for (std::sregex_iterator it(body.begin(), body.end(), jump_threader::identifier), end; it != end; ++it) {
+      if (auto number = numbers.find(it->str()); number != numbers.end()) {
+        result += body.substr(copied, it->position() - copied) + "@" + std::to_string(number->second);
+        copied = it->position() + it->length();
+      }
+    }
+    result += body.substr(copied) + "\n";
+  }
+  return result;
+}
+
+std::string til::code_folder::fold(bool keepAddresses) {
+  std::unordered_map<std::string, size_t> kept; // code -> function
+  std::vector<bool> removed(_lines.size(), false);
+  std::map<size_t, std::vector<std::string>> inserted; // lines added after a line
+
+  for (size_t f = 0; f < _functions.size(); f++) {
+    auto &candidate = _functions[f];
+    if (!selfContained(candidate)) {
+      continue;
+    }
+    auto first = kept.emplace(canonical(candidate), f);
+    if (first.second) {
+      continue;
+    }
+
+    auto &original = _functions[first.first->second];
+    if (keepAddresses || _escaping.count(candidate.label)) {
+      // a copy of its own: a jump to the original
+      for (size_t k = candidate.entry + 1; k < candidate.end; k++) removed[k] = true;
+      inserted[candidate.entry].push_back("\tjmp\t" + original.label);
+    } else {
+      for (size_t k = candidate.begin; k < candidate.end; k++) removed[k] = true;
+      inserted[original.entry].push_back(candidate.label + ":");
+    }
+  }
+
+  std::ostringstream output;
+  for (size_t k = 0; k < _lines.size(); k++) {
+    if (!removed[k]) {
+      output << _lines[k] << '\n';
+    }
+    if (auto lines = inserted.find(k); lines != inserted.end()) {
+      for (auto &line : lines->second) output << line << '\n';
+    }
+  }
+  return output.str();
+}
+
+std::string til::code_folder::optimise(const std::string &assembly, bool keepAddresses) {
+  code_folder folder(assembly);
+  folder.split();
+  folder.findEscaping();
+  return folder.fold(keepAddresses);
+}
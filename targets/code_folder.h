@@ -0,0 +1,54 @@
+#ifndef __TIL_TARGETS_CODE_FOLDER_H__
+#define __TIL_TARGETS_CODE_FOLDER_H__
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace til {
+
+  /**
+   * Identical code folding on the generated assembly. A function is a text
+   * section that starts at a generated label (_L<n>) and ends, before the
+   * next section, with a ret or a jump. Two functions are identical when
+   * their code matches once the labels each one defines are numbered in
+   * order of definition. Every copy but the first is dropped and its label
+   * is defined next to the first one's.
+   *
+   * Functions whose other labels are used outside them are left alone.
+   * When the program may compare function addresses, the copies become a
+   * jump to the first one instead, so they keep addresses of their own.
+   * So do the copies other modules may see, and compare: functions stored
+   * in public data and, when the module has public symbols, functions
+   * used as values.
+   */
+  class code_folder {
+    struct function {
+      size_t begin, end; // lines, from the section directive
+      size_t entry; // line of the label
+      std::string label;
+      std::set<std::string> labels; // defined inside
+    };
+
+    std::vector<std::string> _lines;
+    std::vector<function> _functions;
+    std::map<std::string, std::vector<size_t>> _uses; // lines using each generated label (other than defining it)
+    std::set<std::string> _escaping; // generated labels other modules may see
+
+    code_folder(const std::string &assembly);
+
+    void split();
+    void findEscaping();
+    bool selfContained(const function &candidate) const;
+    std::string canonical(const function &candidate) const;
+    std::string fold(bool keepAddresses);
+
+  public:
+    static std::string optimise(const std::string &assembly, bool keepAddresses);
+
+  };
+
+} // til
+
+#endif
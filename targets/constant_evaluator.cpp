@@ -0,0 +1,476 @@
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include "targets/constant_evaluator.h"
+#include "targets/options.h"
+#include ".auto/all_nodes.h"
+
+std::optional<til::constant_evaluator::constant> til::constant_evaluator::evaluate(std::shared_ptr<cdk::compiler> compiler,
+            const std::map<std::string, constant> &variables,
+            const std::map<std::string, til::function_node*> &functions, cdk::expression_node *expression) {
+  constant_evaluator evaluator(compiler, variables, functions, std::max(0, options::ctfeSteps()));
+  return evaluator.valueOf(expression, 0);
+}
+
+std::optional<til::constant_evaluator::constant> til::constant_evaluator::convert(const constant &value,
+            std::shared_ptr<cdk::basic_type> type) {
+  if (type != nullptr && type->name() == cdk::TYPE_DOUBLE) {
+    return toDouble(value);
+  } else if (type != nullptr && type->name() == cdk::TYPE_INT && std::holds_alternative<int>(value)) {
+    return value;
+  }
+  return std::nullopt;
+}
+
+std::optional<til::constant_evaluator::constant> til::constant_evaluator::valueOf(cdk::expression_node *expression, int lvl) {
+  _value.reset();
+  if (_flow != FAILED) {
+    expression->accept(this, lvl + 2);
+  }
+  auto value = _value;
+  _value.reset();
+  if (_flow == FAILED) {
+    return std::nullopt;
+  }
+
+  // the type checker decides when integers are promoted
+  if (value && std::holds_alternative<int>(*value) && expression->is_typed(cdk::TYPE_DOUBLE)) {
+    return static_cast<double>(std::get<int>(*value));
+  }
+  return value;
+}
+
+/*
+ * Integers are computed modulo 2^32. Integer divisions by zero (and the
+ * overflowing INT_MIN / -1) trap at run time, so they are left to it.
+*/
+void til::constant_evaluator::evaluateArithmetic(cdk::binary_operation_node *const node, int lvl) {
+  if (!node->is_typed(cdk::TYPE_INT) && !node->is_typed(cdk::TYPE_DOUBLE)) {
+    return; // pointer arithmetic
+  }
+  auto left = valueOf(node->left(), lvl);
+  auto right = left ? valueOf(node->right(), lvl) : std::nullopt;
+  if (!left || !right) {
+    return;
+  }
+
+  if (node->is_typed(cdk::TYPE_DOUBLE)) {
+    double l = toDouble(*left), r = toDouble(*right);
+    if (dynamic_cast<cdk::add_node*>(node)) _value = l + r;
+    else if (dynamic_cast<cdk::sub_node*>(node)) _value = l - r;
+    else if (dynamic_cast<cdk::mul_node*>(node)) _value = l * r;
+    else if (dynamic_cast<cdk::div_node*>(node)) _value = l / r;
+    return;
+  }
+
+  int l = std::get<int>(*left), r = std::get<int>(*right);
+  auto ul = static_cast<uint32_t>(l), ur = static_cast<uint32_t>(r);
+  if (dynamic_cast<cdk::add_node*>(node)) {
+    _value = static_cast<int>(ul + ur);
+  } else if (dynamic_cast<cdk::sub_node*>(node)) {
+    _value = static_cast<int>(ul - ur);
+  } else if (dynamic_cast<cdk::mul_node*>(node)) {
+    _value = static_cast<int>(ul * ur);
+  } else if (r == 0 || (l == std::numeric_limits<int>::min() && r == -1)) {
+    return;
+  } else if (dynamic_cast<cdk::div_node*>(node)) {
+    _value = l / r;
+  } else {
+    _value = l % r;
+  }
+}
+
+void til::constant_evaluator::evaluateComparison(cdk::binary_operation_node *const node, int lvl) {
+  auto left = valueOf(node->left(), lvl);
+  auto right = left ? valueOf(node->right(), lvl) : std::nullopt;
+  if (!left || !right) {
+    return;
+  }
+
+  double l = toDouble(*left), r = toDouble(*right); // exact for every int
+  bool result;
+  if (dynamic_cast<cdk::lt_node*>(node)) result = l < r;
+  else if (dynamic_cast<cdk::le_node*>(node)) result = l <= r;
+  else if (dynamic_cast<cdk::ge_node*>(node)) result = l >= r;
+  else if (dynamic_cast<cdk::gt_node*>(node)) result = l > r;
+  else if (dynamic_cast<cdk::ne_node*>(node)) result = l != r;
+  else result = l == r;
+  _value = static_cast<int>(result);
+}
+
+/*
+ * Runs a statement of an interpreted call, unless control is leaving it
+ * or the step budget is spent.
+*/
+void til::constant_evaluator::execute(cdk::basic_node *const node, int lvl) {
+  if (_flow == NORMAL && step()) {
+    node->accept(this, lvl + 2);
+  }
+}
+
+bool til::constant_evaluator::step() {
+  if (_steps == 0) {
+    _flow = FAILED;
+    return false;
+  }
+  _steps--;
+  return true;
+}
+
+/*
+ * The local variable or argument of the current call with the given name,
+ * or nullptr if there is none (outside calls, there are no locals).
+*/
+std::optional<til::constant_evaluator::constant> *til::constant_evaluator::find(const std::string &name) {
+  if (_frames.empty()) {
+    return nullptr;
+  }
+  auto &scopes = _frames.back();
+  for (auto scope = scopes.rbegin(); scope != scopes.rend(); scope++) {
+    if (auto variable = scope->find(name); variable != scope->end()) {
+      return &variable->second;
+    }
+  }
+  return nullptr;
+}
+
+//---------------------------------------------------------------------------
+
+void til::constant_evaluator::do_sequence_node(cdk::sequence_node *const node, int lvl) {
+  for (size_t i = 0; i < node->size(); i++) {
+    execute(node->node(i), lvl);
+  }
+}
+
+//---------------------------------------------------------------------------
+
+void til::constant_evaluator::do_nil_node(cdk::nil_node * const node, int lvl) {
+  // EMPTY
+}
+
+void til::constant_evaluator::do_data_node(cdk::data_node * const node, int lvl) {
+  // EMPTY
+}
+
+void til::constant_evaluator::do_integer_node(cdk::integer_node * const node, int lvl) {
+  _value = node->value();
+}
+
+void til::constant_evaluator::do_double_node(cdk::double_node * const node, int lvl) {
+  _value = node->value();
+}
+
+void til::constant_evaluator::do_string_node(cdk::string_node * const node, int lvl) {
+  // EMPTY
+}
+
+//---------------------------------------------------------------------------
+
+void til::constant_evaluator::do_unary_minus_node(cdk::unary_minus_node * const node, int lvl) {
+  auto value = valueOf(node->argument(), lvl);
+  if (value && std::holds_alternative<int>(*value)) {
+    _value = static_cast<int>(-static_cast<uint32_t>(std::get<int>(*value)));
+  } else if (value) {
+    _value = -std::get<double>(*value);
+  }
+}
+
+void til::constant_evaluator::do_unary_plus_node(cdk::unary_plus_node * const node, int lvl) {
+  _value = valueOf(node->argument(), lvl);
+}
+
+void til::constant_evaluator::do_not_node(cdk::not_node * const node, int lvl) {
+  auto value = valueOf(node->argument(), lvl);
+  if (value && std::holds_alternative<int>(*value)) {
+    _value = static_cast<int>(!std::get<int>(*value));
+  }
+}
+
+void til::constant_evaluator::do_add_node(cdk::add_node * const node, int lvl) {
+  evaluateArithmetic(node, lvl);
+}
+
+void til::constant_evaluator::do_sub_node(cdk::sub_node * const node, int lvl) {
+  evaluateArithmetic(node, lvl);
+}
+
+void til::constant_evaluator::do_mul_node(cdk::mul_node * const node, int lvl) {
+  evaluateArithmetic(node, lvl);
+}
+
+void til::constant_evaluator::do_div_node(cdk::div_node * const node, int lvl) {
+  evaluateArithmetic(node, lvl);
+}
+
+void til::constant_evaluator::do_mod_node(cdk::mod_node * const node, int lvl) {
+  evaluateArithmetic(node, lvl);
+}
+
+void til::constant_evaluator::do_lt_node(cdk::lt_node * const node, int lvl) {
+  evaluateComparison(node, lvl);
+}
+
+void til::constant_evaluator::do_le_node(cdk::le_node * const node, int lvl) {
+  evaluateComparison(node, lvl);
+}
+
+void til::constant_evaluator::do_ge_node(cdk::ge_node * const node, int lvl) {
+  evaluateComparison(node, lvl);
+}
+
+void til::constant_evaluator::do_gt_node(cdk::gt_node * const node, int lvl) {
+  evaluateComparison(node, lvl);
+}
+
+void til::constant_evaluator::do_ne_node(cdk::ne_node * const node, int lvl) {
+  evaluateComparison(node, lvl);
+}
+
+void til::constant_evaluator::do_eq_node(cdk::eq_node * const node, int lvl) {
+  evaluateComparison(node, lvl);
+}
+
+void til::constant_evaluator::do_and_node(cdk::and_node * const node, int lvl) {
+  // as generated: a false left operand is the value, otherwise both are ANDed bitwise
+  auto left = valueOf(node->left(), lvl);
+  if (!left || !std::holds_alternative<int>(*left)) {
+    return;
+  } else if (std::get<int>(*left) == 0) {
+    _value = 0;
+    return;
+  }
+  auto right = valueOf(node->right(), lvl);
+  if (right && std::holds_alternative<int>(*right)) {
+    _value = std::get<int>(*left) & std::get<int>(*right);
+  }
+}
+
+void til::constant_evaluator::do_or_node(cdk::or_node * const node, int lvl) {
+  // as generated: a true left operand is the value, otherwise both are ORed bitwise
+  auto left = valueOf(node->left(), lvl);
+  if (!left || !std::holds_alternative<int>(*left)) {
+    return;
+  } else if (std::get<int>(*left) != 0) {
+    _value = std::get<int>(*left);
+    return;
+  }
+  auto right = valueOf(node->right(), lvl);
+  if (right && std::holds_alternative<int>(*right)) {
+    _value = std::get<int>(*left) | std::get<int>(*right);
+  }
+}
+
+//---------------------------------------------------------------------------
+
+void til::constant_evaluator::do_variable_node(cdk::variable_node * const node, int lvl) {
+  // EMPTY
+}
+
+void til::constant_evaluator::do_rvalue_node(cdk::rvalue_node * const node, int lvl) {
+  auto var = dynamic_cast<cdk::variable_node*>(node->lvalue());
+  if (var == nullptr) {
+    return;
+  }
+  if (auto local = find(var->name())) {
+    _value = *local; // nothing if it was not initialized
+  } else if (auto value = _variables.find(var->name()); value != _variables.end()) {
+    _value = value->second;
+  }
+}
+
+void til::constant_evaluator::do_assignment_node(cdk::assignment_node * const node, int lvl) {
+  // only the locals of the call can be written
+  auto var = dynamic_cast<cdk::variable_node*>(node->lvalue());
+  auto local = var ? find(var->name()) : nullptr;
+  if (local == nullptr) {
+    return;
+  }
+
+  auto value = valueOf(node->rvalue(), lvl);
+  if (value && (*local = convert(*value, node->lvalue()->type()))) {
+    _value = *local;
+  }
+}
+
+//---------------------------------------------------------------------------
+
+void til::constant_evaluator::do_evaluation_node(til::evaluation_node * const node, int lvl) {
+  if (!valueOf(node->argument(), lvl)) _flow = FAILED;
+}
+
+void til::constant_evaluator::do_print_node(til::print_node * const node, int lvl) {
+  _flow = FAILED;
+}
+
+void til::constant_evaluator::do_read_node(til::read_node * const node, int lvl) {
+  // EMPTY
+}
+
+//---------------------------------------------------------------------------
+
+void til::constant_evaluator::do_if_node(til::if_node * const node, int lvl) {
+  auto condition = valueOf(node->condition(), lvl);
+  if (!condition || !std::holds_alternative<int>(*condition)) {
+    _flow = FAILED;
+  } else if (std::get<int>(*condition)) {
+    execute(node->block(), lvl);
+  }
+}
+
+void til::constant_evaluator::do_if_else_node(til::if_else_node * const node, int lvl) {
+  auto condition = valueOf(node->condition(), lvl);
+  if (!condition || !std::holds_alternative<int>(*condition)) {
+    _flow = FAILED;
+  } else {
+    execute(std::get<int>(*condition) ? node->thenblock() : node->elseblock(), lvl);
+  }
+}
+
+//---------------------------------------------------------------------------
+
+void til::constant_evaluator::do_alloc_node(til::alloc_node * const node, int lvl) {
+  // EMPTY
+}
+
+void til::constant_evaluator::do_address_of_node(til::address_of_node * const node, int lvl) {
+  // EMPTY
+}
+
+void til::constant_evaluator::do_index_node(til::index_node * const node, int lvl) {
+  // EMPTY
+}
+
+void til::constant_evaluator::do_nullptr_node(til::nullptr_node * const node, int lvl) {
+  // EMPTY
+}
+
+void til::constant_evaluator::do_sizeof_node(til::sizeof_node * const node, int lvl) {
+  if (node->argument()->type() != nullptr) {
+    _value = static_cast<int>(node->argument()->type()->size()); // the argument is not evaluated
+  }
+}
+
+//---------------------------------------------------------------------------
+
+void til::constant_evaluator::do_block_node(til::block_node * const node, int lvl) {
+  if (_frames.empty()) {
+    _flow = FAILED;
+    return;
+  }
+  _frames.back().push_back(scope());
+  node->declarations()->accept(this, lvl);
+  node->instructions()->accept(this, lvl);
+  _frames.back().pop_back();
+}
+
+void til::constant_evaluator::do_declaration_node(til::declaration_node * const node, int lvl) {
+  std::optional<constant> value;
+  if (node->initializer() != nullptr) {
+    auto initializer = valueOf(node->initializer(), lvl);
+    if (!initializer || !(value = convert(*initializer, node->type()))) {
+      _flow = FAILED;
+      return;
+    }
+  } else if (!node->is_typed(cdk::TYPE_INT) && !node->is_typed(cdk::TYPE_DOUBLE)) {
+    _flow = FAILED;
+    return;
+  }
+  _frames.back().back()[node->identifier()] = value;
+}
+
+void til::constant_evaluator::do_function_node(til::function_node * const node, int lvl) {
+  // EMPTY
+}
+
+void til::constant_evaluator::do_function_call_node(til::function_call_node * const node, int lvl) {
+  til::function_node *callee = nullptr;
+  if (_frames.size() >= maxCallDepth) {
+    _flow = FAILED;
+    return;
+  } else if (node->func() == nullptr) {
+    if (_callees.empty()) return;
+    callee = _callees.back();
+  } else if (auto rvalue = dynamic_cast<cdk::rvalue_node*>(node->func())) {
+    // locals only hold numbers, so a local name hides the function
+    auto var = dynamic_cast<cdk::variable_node*>(rvalue->lvalue());
+    auto function = var && !find(var->name()) ? _functions.find(var->name()) : _functions.end();
+    if (function == _functions.end()) return;
+    callee = function->second;
+  } else {
+    return;
+  }
+
+  if (callee->args()->size() != node->args()->size()) {
+    return;
+  }
+  scope arguments;
+  for (size_t i = 0; i < node->args()->size(); i++) {
+    auto parameter = dynamic_cast<til::declaration_node*>(callee->args()->node(i));
+    auto value = valueOf(dynamic_cast<cdk::expression_node*>(node->args()->node(i)), lvl);
+    if (!value || !(arguments[parameter->identifier()] = convert(*value, parameter->type()))) {
+      return;
+    }
+  }
+
+  _frames.push_back({ arguments });
+  _callees.push_back(callee);
+  execute(callee->block(), lvl);
+  _callees.pop_back();
+  _frames.pop_back();
+
+  // void calls only appear as statements: any value will do
+  bool isVoid = cdk::functional_type::cast(callee->type())->output(0)->name() == cdk::TYPE_VOID;
+  if (_flow == RETURN || (_flow == NORMAL && isVoid)) {
+    _flow = NORMAL;
+    _value = isVoid ? constant(0) : _returned;
+  } else {
+    _flow = FAILED; // fell off the end of a function with a result, or left it with next/stop
+  }
+  _returned.reset();
+}
+
+void til::constant_evaluator::do_return_node(til::return_node * const node, int lvl) {
+  if (node->retValue() != nullptr) {
+    auto value = valueOf(node->retValue(), lvl);
+    auto output = cdk::functional_type::cast(_callees.back()->type())->output(0);
+    if (!value || !(_returned = convert(*value, output))) {
+      _flow = FAILED;
+      return;
+    }
+  }
+  _flow = RETURN;
+}
+
+//---------------------------------------------------------------------------
+
+void til::constant_evaluator::do_loop_node(til::loop_node * const node, int lvl) {
+  while (_flow == NORMAL && step()) {
+    auto condition = valueOf(node->condition(), lvl);
+    if (!condition || !std::holds_alternative<int>(*condition)) {
+      _flow = FAILED;
+      return;
+    } else if (std::get<int>(*condition) == 0) {
+      return;
+    }
+
+    execute(node->block(), lvl);
+    if ((_flow == NEXT || _flow == STOP) && --_exits > 0) {
+      return; // it continues or stops an outer loop
+    } else if (_flow == STOP) {
+      _flow = NORMAL;
+      return;
+    } else if (_flow == NEXT) {
+      _flow = NORMAL;
+    }
+  }
+}
+
+void til::constant_evaluator::do_next_node(til::next_node * const node, int lvl) {
+  _flow = node->nIterations() > 0 ? NEXT : FAILED;
+  _exits = node->nIterations();
+}
+
+void til::constant_evaluator::do_stop_node(til::stop_node * const node, int lvl) {
+  _flow = node->nIterations() > 0 ? STOP : FAILED;
+  _exits = node->nIterations();
+}
@@ -0,0 +1,86 @@
+#ifndef __TIL_TARGETS_CONSTANT_EVALUATOR_H__
+#define __TIL_TARGETS_CONSTANT_EVALUATOR_H__
+
+#include "targets/basic_ast_visitor.h"
+#include <map>
+#include <optional>
+#include <variant>
+#include <vector>
+
+namespace til {
+
+    /**
+     * Evaluates typed expressions at compile time: literals, arithmetic,
+     * comparisons, logical operators, sizeof and reads of the variables in
+     * a table of known values. Anything else (or a division that would trap)
+     * makes the expression non-constant. Integers wrap around like the
+     * generated code does.
+     *
+     * Calls of the given functions are interpreted too, with int and double
+     * locals, blocks, conditionals, loops and returns. Interpretation gives
+     * up on anything with an effect outside the call (or that it does not
+     * model, such as pointers) and after a bounded number of steps.
+     */
+    class constant_evaluator: public basic_ast_visitor {
+    public:
+        typedef std::variant<int, double> constant;
+
+    private:
+        enum flow { NORMAL, NEXT, STOP, RETURN, FAILED };
+        typedef std::map<std::string, std::optional<constant>> scope; // nullopt: not initialized
+
+        static constexpr size_t maxCallDepth = 64;
+
+        const std::map<std::string, constant> &_variables;
+        const std::map<std::string, til::function_node*> &_functions;
+        std::optional<constant> _value;
+        std::vector<std::vector<scope>> _frames; // the scopes of each active call
+        std::vector<til::function_node*> _callees; // targets of @
+        flow _flow = NORMAL;
+        int _exits = 0; // loops left by next and stop
+        std::optional<constant> _returned;
+        size_t _steps;
+
+    public:
+        constant_evaluator(std::shared_ptr<cdk::compiler> compiler, const std::map<std::string, constant> &variables,
+                    const std::map<std::string, til::function_node*> &functions, size_t steps) :
+            basic_ast_visitor(compiler), _variables(variables), _functions(functions), _steps(steps) {
+        }
+
+    public:
+        ~constant_evaluator() {
+            os().flush();
+        }
+
+    public:
+        static std::optional<constant> evaluate(std::shared_ptr<cdk::compiler> compiler,
+                    const std::map<std::string, constant> &variables,
+                    const std::map<std::string, til::function_node*> &functions, cdk::expression_node *expression);
+
+        static double toDouble(const constant &value) {
+            return std::holds_alternative<int>(value) ? std::get<int>(value) : std::get<double>(value);
+        }
+
+        /** Converts value to a variable of the given type (int or double). */
+        static std::optional<constant> convert(const constant &value, std::shared_ptr<cdk::basic_type> type);
+
+    private:
+        std::optional<constant> valueOf(cdk::expression_node *expression, int lvl);
+        void evaluateArithmetic(cdk::binary_operation_node *const node, int lvl);
+        void evaluateComparison(cdk::binary_operation_node *const node, int lvl);
+        void execute(cdk::basic_node *const node, int lvl);
+        std::optional<constant> *find(const std::string &name);
+        bool step();
+
+    public:
+    // do not edit these lines
+#define __IN_VISITOR_HEADER__
+#include ".auto/visitor_decls.h"      // automatically generated
+#undef __IN_VISITOR_HEADER__
+    // do not edit these lines: end
+
+    };
+
+} // til
+
+#endif
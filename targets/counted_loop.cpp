@@ -0,0 +1,178 @@
+#include <algorithm>
+#include "targets/counted_loop.h"
+#include ".auto/all_nodes.h"
+
+std::optional<std::string> til::counted_loop::readVariable(cdk::expression_node *const expression) {
+  auto rvalue = dynamic_cast<cdk::rvalue_node*>(expression);
+  if (rvalue == nullptr) {
+    return std::nullopt;
+  }
+
+  auto var = dynamic_cast<cdk::variable_node*>(rvalue->lvalue());
+  if (var == nullptr) {
+    return std::nullopt;
+  }
+  return var->name();
+}
+
+std::optional<til::counted_loop> til::counted_loop::recognise(std::shared_ptr<cdk::compiler> compiler, til::loop_node *node) {
+  counted_loop loop(node);
+
+  // the condition compares the counter with the bound
+  auto condition = dynamic_cast<cdk::binary_operation_node*>(node->condition());
+  bool ascending;
+  if (dynamic_cast<cdk::lt_node*>(condition) || dynamic_cast<cdk::le_node*>(condition)) {
+    ascending = true;
+    loop._inclusive = dynamic_cast<cdk::le_node*>(condition) != nullptr;
+  } else if (dynamic_cast<cdk::gt_node*>(condition) || dynamic_cast<cdk::ge_node*>(condition)) {
+    ascending = false;
+    loop._inclusive = dynamic_cast<cdk::ge_node*>(condition) != nullptr;
+  } else {
+    return std::nullopt;
+  }
+
+  auto counter = readVariable(condition->left());
+  if (!counter) {
+    return std::nullopt;
+  }
+  loop._counter = *counter;
+
+  loop._bound = condition->right();
+  if (!dynamic_cast<cdk::integer_node*>(loop._bound)) {
+    loop._boundVariable = readVariable(loop._bound);
+    if (!loop._boundVariable || *loop._boundVariable == loop._counter) {
+      return std::nullopt;
+    }
+  }
+
+  // the body ends with (set i (+ i step)), (set i (+ step i)) or (set i (- i step))
+  loop._body = dynamic_cast<til::block_node*>(node->block());
+  if (loop._body == nullptr || loop._body->instructions()->size() == 0) {
+    return std::nullopt;
+  }
+
+  auto instructions = loop._body->instructions();
+  loop._increment = dynamic_cast<til::evaluation_node*>(instructions->node(instructions->size() - 1));
+  if (loop._increment == nullptr) {
+    return std::nullopt;
+  }
+
+  auto assignment = dynamic_cast<cdk::assignment_node*>(loop._increment->argument());
+  if (assignment == nullptr) {
+    return std::nullopt;
+  }
+  auto target = dynamic_cast<cdk::variable_node*>(assignment->lvalue());
+  if (target == nullptr || target->name() != loop._counter) {
+    return std::nullopt;
+  }
+
+  auto operation = dynamic_cast<cdk::binary_operation_node*>(assignment->rvalue());
+  if (dynamic_cast<cdk::add_node*>(operation)) {
+    auto left = dynamic_cast<cdk::integer_node*>(operation->left());
+    auto right = dynamic_cast<cdk::integer_node*>(operation->right());
+    if (right != nullptr && readVariable(operation->left()) == loop._counter) {
+      loop._step = right->value();
+    } else if (left != nullptr && readVariable(operation->right()) == loop._counter) {
+      loop._step = left->value();
+    }
+  } else if (dynamic_cast<cdk::sub_node*>(operation)) {
+    auto right = dynamic_cast<cdk::integer_node*>(operation->right());
+    if (right != nullptr && readVariable(operation->left()) == loop._counter) {
+      loop._step = -right->value();
+    }
+  }
+
+  if (loop._step == 0 || (loop._step > 0) != ascending) {
+    return std::nullopt;
+  }
+
+  // the rest of the body must leave the counter and the bound alone
+  loop._effects = std::make_shared<til::effect_analyser>(compiler);
+  loop._body->declarations()->accept(loop._effects.get(), 0);
+  for (size_t i = 0; i + 1 < instructions->size(); i++) {
+    instructions->node(i)->accept(loop._effects.get(), 0);
+  }
+
+  auto effects = loop._effects;
+  for (auto &name : { std::optional<std::string>(loop._counter), loop._boundVariable }) {
+    if (name && (effects->assigned().count(*name) || effects->addressTaken().count(*name)
+                 || effects->declared().count(*name))) {
+      return std::nullopt;
+    }
+  }
+
+  if (effects->hasLoopExits()) {
+    return std::nullopt;
+  }
+
+  // group the accesses that move with the counter by array and offset
+  for (auto index : effects->indexes()) {
+    auto array = readVariable(index->pointer());
+    auto offset = loop.linearOffset(index->index());
+    if (!array || !offset || *array == loop._counter || effects->assigned().count(*array)
+        || effects->addressTaken().count(*array) || effects->declared().count(*array)) {
+      continue;
+    }
+
+    auto pointer = std::find_if(loop._derivedPointers.begin(), loop._derivedPointers.end(),
+        [&](auto &p) { return p.array == *array && p.offset == *offset; });
+    if (pointer == loop._derivedPointers.end()) {
+      loop._derivedPointers.push_back({ *array, *offset, { index } });
+    } else {
+      pointer->accesses.push_back(index);
+    }
+  }
+
+  return loop;
+}
+
+std::optional<int> til::counted_loop::linearOffset(cdk::expression_node *expression) const {
+  if (readVariable(expression) == _counter) {
+    return 0;
+  }
+
+  auto operation = dynamic_cast<cdk::binary_operation_node*>(expression);
+  if (dynamic_cast<cdk::add_node*>(operation)) {
+    auto left = dynamic_cast<cdk::integer_node*>(operation->left());
+    auto right = dynamic_cast<cdk::integer_node*>(operation->right());
+    if (right != nullptr && readVariable(operation->left()) == _counter) {
+      return right->value();
+    } else if (left != nullptr && readVariable(operation->right()) == _counter) {
+      return left->value();
+    }
+  } else if (dynamic_cast<cdk::sub_node*>(operation)) {
+    auto right = dynamic_cast<cdk::integer_node*>(operation->right());
+    if (right != nullptr && readVariable(operation->left()) == _counter) {
+      return -right->value();
+    }
+  }
+  return std::nullopt;
+}
+
+cdk::expression_node *til::counted_loop::condition(cdk::expression_node *bound) const {
+  auto condition = dynamic_cast<cdk::binary_operation_node*>(_loop->condition());
+  auto lineno = condition->lineno();
+
+  if (ascending()) {
+    if (_inclusive) return new cdk::le_node(lineno, condition->left(), bound);
+    return new cdk::lt_node(lineno, condition->left(), bound);
+  }
+  if (_inclusive) return new cdk::ge_node(lineno, condition->left(), bound);
+  return new cdk::gt_node(lineno, condition->left(), bound);
+}
+
+std::optional<long long> til::counted_loop::tripCount(int start) const {
+  auto literal = dynamic_cast<cdk::integer_node*>(_bound);
+  if (literal == nullptr) {
+    return std::nullopt;
+  }
+
+  long long first = start, step = _step, limit = literal->value();
+  if (ascending()) {
+    if (_inclusive) limit++;
+    return first >= limit ? 0 : (limit - first + step - 1) / step;
+  }
+
+  if (_inclusive) limit--;
+  return first <= limit ? 0 : (first - limit - step - 1) / -step;
+}
@@ -0,0 +1,90 @@
+#ifndef __TIL_TARGETS_COUNTED_LOOP_H__
+#define __TIL_TARGETS_COUNTED_LOOP_H__
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+#include <cdk/compiler.h>
+#include "targets/effect_analyser.h"
+
+namespace til {
+
+  /**
+   * Describes a loop that counts an int variable towards a loop-invariant bound:
+   *
+   *   (loop (OP i bound) (block ... (set i (+ i step))))
+   *
+   * OP is one of <, <=, > or >=, step is a non-zero literal that moves i
+   * towards the bound, and the rest of the body neither writes i or the
+   * bound, nor leaves the loop with next/stop. Recognition is syntactic:
+   * callers still have to check the variables against the symbol table.
+   */
+  class counted_loop {
+  public:
+    /** Accesses (index a (+ i offset)) to an array a that does not change in the loop. */
+    struct derived_pointer {
+      std::string array;
+      int offset;
+      std::vector<til::index_node*> accesses;
+    };
+
+  private:
+    til::loop_node *_loop;
+    til::block_node *_body;
+    til::evaluation_node *_increment; // last instruction of the body
+    std::string _counter;
+    cdk::expression_node *_bound;
+    std::optional<std::string> _boundVariable; // set when the bound is not a literal
+    int _step;
+    bool _inclusive; // <= or >=
+    std::shared_ptr<til::effect_analyser> _effects; // body without the increment
+    std::vector<derived_pointer> _derivedPointers;
+
+    counted_loop(til::loop_node *loop) :
+        _loop(loop), _body(nullptr), _increment(nullptr), _bound(nullptr), _step(0), _inclusive(false) {
+    }
+
+  public:
+    static std::optional<counted_loop> recognise(std::shared_ptr<cdk::compiler> compiler, til::loop_node *node);
+
+    /** Name of the variable read by expression, if it is a plain rvalue. */
+    static std::optional<std::string> readVariable(cdk::expression_node *const expression);
+
+  public:
+    til::loop_node *loop() const { return _loop; }
+
+    til::block_node *body() const { return _body; }
+
+    til::evaluation_node *increment() const { return _increment; }
+
+    const std::string &counter() const { return _counter; }
+
+    cdk::expression_node *bound() const { return _bound; }
+
+    const std::optional<std::string> &boundVariable() const { return _boundVariable; }
+
+    int step() const { return _step; }
+
+    bool ascending() const { return _step > 0; }
+
+    bool inclusive() const { return _inclusive; }
+
+    std::shared_ptr<til::effect_analyser> effects() const { return _effects; }
+
+    const std::vector<derived_pointer> &derivedPointers() const { return _derivedPointers; }
+
+    /** Offset c if expression is i, (+ i c), (+ c i) or (- i c). */
+    std::optional<int> linearOffset(cdk::expression_node *expression) const;
+
+    /** Builds the loop's comparison of the counter against another bound. */
+    cdk::expression_node *condition(cdk::expression_node *bound) const;
+
+    /** Number of iterations when the counter starts at start (literal bounds only). */
+    std::optional<long long> tripCount(int start) const;
+
+  };
+
+} // til
+
+#endif
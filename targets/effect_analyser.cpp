@@ -0,0 +1,296 @@
+#include "targets/effect_analyser.h"
+#include ".auto/all_nodes.h"
+
+void til::effect_analyser::do_sequence_node(cdk::sequence_node *const node, int lvl) {
+  for (size_t i = 0; i < node->size(); i++) {
+    node->node(i)->accept(this, lvl);
+  }
+}
+
+//---------------------------------------------------------------------------
+
+void til::effect_analyser::do_nil_node(cdk::nil_node * const node, int lvl) {
+  _nodes++;
+}
+
+void til::effect_analyser::do_data_node(cdk::data_node * const node, int lvl) {
+  _nodes++;
+}
+
+void til::effect_analyser::do_integer_node(cdk::integer_node * const node, int lvl) {
+  _nodes++;
+}
+
+void til::effect_analyser::do_double_node(cdk::double_node * const node, int lvl) {
+  _nodes++;
+}
+
+void til::effect_analyser::do_string_node(cdk::string_node * const node, int lvl) {
+  _nodes++;
+}
+
+//---------------------------------------------------------------------------
+
+void til::effect_analyser::do_unary_minus_node(cdk::unary_minus_node * const node, int lvl) {
+  _nodes++;
+  node->argument()->accept(this, lvl);
+}
+
+void til::effect_analyser::do_unary_plus_node(cdk::unary_plus_node * const node, int lvl) {
+  _nodes++;
+  node->argument()->accept(this, lvl);
+}
+
+void til::effect_analyser::do_not_node(cdk::not_node * const node, int lvl) {
+  _nodes++;
+  node->argument()->accept(this, lvl);
+}
+
+void til::effect_analyser::do_add_node(cdk::add_node * const node, int lvl) {
+  _nodes++;
+  node->left()->accept(this, lvl);
+  node->right()->accept(this, lvl);
+}
+
+void til::effect_analyser::do_sub_node(cdk::sub_node * const node, int lvl) {
+  _nodes++;
+  node->left()->accept(this, lvl);
+  node->right()->accept(this, lvl);
+}
+
+void til::effect_analyser::do_mul_node(cdk::mul_node * const node, int lvl) {
+  _nodes++;
+  node->left()->accept(this, lvl);
+  node->right()->accept(this, lvl);
+}
+
+void til::effect_analyser::do_div_node(cdk::div_node * const node, int lvl) {
+  _nodes++;
+  _hasDivisions = true;
+  node->left()->accept(this, lvl);
+  node->right()->accept(this, lvl);
+}
+
+void til::effect_analyser::do_mod_node(cdk::mod_node * const node, int lvl) {
+  _nodes++;
+  _hasDivisions = true;
+  node->left()->accept(this, lvl);
+  node->right()->accept(this, lvl);
+}
+
+void til::effect_analyser::do_lt_node(cdk::lt_node * const node, int lvl) {
+  _nodes++;
+  node->left()->accept(this, lvl);
+  node->right()->accept(this, lvl);
+}
+
+void til::effect_analyser::do_le_node(cdk::le_node * const node, int lvl) {
+  _nodes++;
+  node->left()->accept(this, lvl);
+  node->right()->accept(this, lvl);
+}
+
+void til::effect_analyser::do_ge_node(cdk::ge_node * const node, int lvl) {
+  _nodes++;
+  node->left()->accept(this, lvl);
+  node->right()->accept(this, lvl);
+}
+
+void til::effect_analyser::do_gt_node(cdk::gt_node * const node, int lvl) {
+  _nodes++;
+  node->left()->accept(this, lvl);
+  node->right()->accept(this, lvl);
+}
+
+void til::effect_analyser::do_ne_node(cdk::ne_node * const node, int lvl) {
+  _nodes++;
+  node->left()->accept(this, lvl);
+  node->right()->accept(this, lvl);
+}
+
+void til::effect_analyser::do_eq_node(cdk::eq_node * const node, int lvl) {
+  _nodes++;
+  node->left()->accept(this, lvl);
+  node->right()->accept(this, lvl);
+}
+
+void til::effect_analyser::do_and_node(cdk::and_node * const node, int lvl) {
+  _nodes++;
+  _hasShortCircuits = true;
+  node->left()->accept(this, lvl);
+  node->right()->accept(this, lvl);
+}
+
+void til::effect_analyser::do_or_node(cdk::or_node * const node, int lvl) {
+  _nodes++;
+  _hasShortCircuits = true;
+  node->left()->accept(this, lvl);
+  node->right()->accept(this, lvl);
+}
+
+//---------------------------------------------------------------------------
+
+void til::effect_analyser::do_variable_node(cdk::variable_node * const node, int lvl) {
+  _nodes++;
+}
+
+void til::effect_analyser::do_rvalue_node(cdk::rvalue_node * const node, int lvl) {
+  _nodes++;
+  if (auto var = dynamic_cast<cdk::variable_node*>(node->lvalue())) {
+    _reads[var->name()]++;
+    _weightedUses[var->name()] += useWeight();
+  } else if (dynamic_cast<til::index_node*>(node->lvalue())) {
+    _elementLoads.push_back(node);
+  }
+  node->lvalue()->accept(this, lvl);
+}
+
+void til::effect_analyser::do_assignment_node(cdk::assignment_node * const node, int lvl) {
+  _nodes++;
+  _assignments.push_back(node);
+  if (auto var = dynamic_cast<cdk::variable_node*>(node->lvalue())) {
+    _assigned.insert(var->name());
+    _weightedUses[var->name()] += useWeight();
+  } else {
+    _hasIndexStores = true;
+  }
+
+  node->lvalue()->accept(this, lvl);
+  node->rvalue()->accept(this, lvl);
+}
+
+//---------------------------------------------------------------------------
+
+void til::effect_analyser::do_evaluation_node(til::evaluation_node * const node, int lvl) {
+  _nodes++;
+  if (auto call = dynamic_cast<til::function_call_node*>(node->argument())) {
+    _discardedCalls.insert(call);
+  }
+  node->argument()->accept(this, lvl);
+}
+
+void til::effect_analyser::do_print_node(til::print_node * const node, int lvl) {
+  _nodes++;
+  _hasIO = true;
+  node->arguments()->accept(this, lvl);
+}
+
+void til::effect_analyser::do_read_node(til::read_node * const node, int lvl) {
+  _nodes++;
+  _hasIO = true;
+}
+
+//---------------------------------------------------------------------------
+
+void til::effect_analyser::do_if_node(til::if_node * const node, int lvl) {
+  _nodes++;
+  node->condition()->accept(this, lvl);
+  node->block()->accept(this, lvl);
+}
+
+void til::effect_analyser::do_if_else_node(til::if_else_node * const node, int lvl) {
+  _nodes++;
+  node->condition()->accept(this, lvl);
+  node->thenblock()->accept(this, lvl);
+  node->elseblock()->accept(this, lvl);
+}
+
+//---------------------------------------------------------------------------
+
+void til::effect_analyser::do_alloc_node(til::alloc_node * const node, int lvl) {
+  _nodes++;
+  _hasAllocs = true;
+  node->argument()->accept(this, lvl);
+}
+
+void til::effect_analyser::do_address_of_node(til::address_of_node * const node, int lvl) {
+  _nodes++;
+  if (auto var = dynamic_cast<cdk::variable_node*>(node->lvalue())) {
+    _addressTaken.insert(var->name());
+  }
+  node->lvalue()->accept(this, lvl);
+}
+
+void til::effect_analyser::do_index_node(til::index_node * const node, int lvl) {
+  _nodes++;
+  _indexes.push_back(node);
+  node->pointer()->accept(this, lvl);
+  node->index()->accept(this, lvl);
+}
+
+void til::effect_analyser::do_nullptr_node(til::nullptr_node * const node, int lvl) {
+  _nodes++;
+}
+
+void til::effect_analyser::do_sizeof_node(til::sizeof_node * const node, int lvl) {
+  _nodes++; // the argument is not evaluated
+}
+
+//---------------------------------------------------------------------------
+
+void til::effect_analyser::do_block_node(til::block_node * const node, int lvl) {
+  _nodes++;
+  node->declarations()->accept(this, lvl);
+  node->instructions()->accept(this, lvl);
+}
+
+void til::effect_analyser::do_declaration_node(til::declaration_node * const node, int lvl) {
+  _nodes++;
+  _declared.insert(node->identifier());
+  _declarations[node->identifier()].push_back(node);
+  if (node->initializer() != nullptr) {
+    node->initializer()->accept(this, lvl);
+  }
+}
+
+void til::effect_analyser::do_function_node(til::function_node * const node, int lvl) {
+  _nodes++;
+  _hasFunctions = true; // the body is not executed here
+  if (_enterFunctions) {
+    for (size_t i = 0; i < node->args()->size(); i++) {
+      _parameters.insert(dynamic_cast<til::declaration_node*>(node->args()->node(i)));
+    }
+    node->args()->accept(this, lvl);
+    node->block()->accept(this, lvl);
+  }
+}
+
+void til::effect_analyser::do_function_call_node(til::function_call_node * const node, int lvl) {
+  _nodes++;
+  _hasCalls = true;
+  _calls.push_back(std::make_pair(node, _loopDepth));
+  if (node->func() != nullptr) {
+    node->func()->accept(this, lvl);
+  }
+  node->args()->accept(this, lvl);
+}
+
+void til::effect_analyser::do_return_node(til::return_node * const node, int lvl) {
+  _nodes++;
+  _hasReturns = true;
+  if (node->retValue() != nullptr) {
+    node->retValue()->accept(this, lvl);
+  }
+}
+
+//---------------------------------------------------------------------------
+
+void til::effect_analyser::do_loop_node(til::loop_node * const node, int lvl) {
+  _nodes++;
+  _hasLoops = true;
+  node->condition()->accept(this, lvl);
+  _loopDepth++;
+  node->block()->accept(this, lvl);
+  _loopDepth--;
+}
+
+void til::effect_analyser::do_next_node(til::next_node * const node, int lvl) {
+  _nodes++;
+  // leaves the analysed subtree if it targets a loop outside it
+  if (node->nIterations() > _loopDepth) _hasLoopExits = true;
+}
+
+void til::effect_analyser::do_stop_node(til::stop_node * const node, int lvl) {
+  _nodes++;
+  if (node->nIterations() > _loopDepth) _hasLoopExits = true;
+}
@@ -0,0 +1,151 @@
+#ifndef __TIL_TARGETS_EFFECT_ANALYSER_H__
+#define __TIL_TARGETS_EFFECT_ANALYSER_H__
+
+#include "targets/basic_ast_visitor.h"
+#include <algorithm>
+#include <map>
+#include <set>
+#include <vector>
+
+namespace til {
+
+    /**
+     * Collects the side effects of a subtree (without generating code).
+     * Nested function literals are not entered unless asked to (for
+     * module-wide facts): their bodies do not run when the literal is
+     * evaluated.
+     */
+    class effect_analyser: public basic_ast_visitor {
+        std::set<std::string> _assigned; // variables written by assignments
+        std::set<std::string> _addressTaken; // variables used with ?
+        std::set<std::string> _declared; // variables declared inside the subtree
+        std::map<std::string, size_t> _reads; // number of rvalues of each variable
+        std::map<std::string, std::vector<til::declaration_node*>> _declarations; // declarations of each name
+        std::set<til::declaration_node*> _parameters; // of the function bodies entered
+        std::map<std::string, size_t> _weightedUses; // reads and writes of each variable, weighted by loop depth
+        std::vector<til::index_node*> _indexes; // every indexed access
+        std::vector<cdk::rvalue_node*> _elementLoads; // the indexed accesses that are read
+        std::vector<std::pair<til::function_call_node*, int>> _calls; // every call and its loop depth
+        std::set<til::function_call_node*> _discardedCalls; // calls whose value is not used
+        std::vector<cdk::assignment_node*> _assignments; // every store
+        bool _hasCalls = false;
+        bool _hasIO = false;
+        bool _hasAllocs = false;
+        bool _hasIndexStores = false;
+        bool _hasFunctions = false;
+        bool _hasReturns = false;
+        bool _hasLoopExits = false; // next/stop leaving the subtree
+        bool _hasLoops = false;
+        bool _hasDivisions = false; // / or %, which may trap
+        bool _hasShortCircuits = false; // and/or, whose right operand may not run
+        int _loopDepth = 0;
+        size_t _nodes = 0;
+        bool _enterFunctions; // also collect the effects of nested function bodies
+
+        /** Weight of a use at the current loop depth (each level counts as 8 iterations). */
+        inline size_t useWeight() {
+            return size_t(1) << (3 * std::min(_loopDepth, 8));
+        }
+
+    public:
+        effect_analyser(std::shared_ptr<cdk::compiler> compiler, bool enterFunctions = false) :
+            basic_ast_visitor(compiler), _enterFunctions(enterFunctions) {
+        }
+
+    public:
+        ~effect_analyser() {
+            os().flush();
+        }
+
+    public:
+        inline const std::set<std::string> &assigned() {
+            return _assigned;
+        }
+        inline const std::set<std::string> &addressTaken() {
+            return _addressTaken;
+        }
+        inline const std::set<std::string> &declared() {
+            return _declared;
+        }
+        inline size_t reads(const std::string &name) {
+            auto it = _reads.find(name);
+            return it == _reads.end() ? 0 : it->second;
+        }
+        inline const std::map<std::string, size_t> &reads() {
+            return _reads;
+        }
+        inline const std::map<std::string, std::vector<til::declaration_node*>> &declarations() {
+            return _declarations;
+        }
+        inline const std::set<til::declaration_node*> &parameters() {
+            return _parameters;
+        }
+        inline const std::map<std::string, size_t> &weightedUses() {
+            return _weightedUses;
+        }
+        inline const std::vector<til::index_node*> &indexes() {
+            return _indexes;
+        }
+        inline const std::vector<cdk::rvalue_node*> &elementLoads() {
+            return _elementLoads;
+        }
+        inline const std::vector<std::pair<til::function_call_node*, int>> &calls() {
+            return _calls;
+        }
+        inline const std::set<til::function_call_node*> &discardedCalls() {
+            return _discardedCalls;
+        }
+        inline const std::vector<cdk::assignment_node*> &assignments() {
+            return _assignments;
+        }
+        inline bool hasCalls() {
+            return _hasCalls;
+        }
+        inline bool hasIO() {
+            return _hasIO;
+        }
+        inline bool hasAllocs() {
+            return _hasAllocs;
+        }
+        inline bool hasIndexStores() {
+            return _hasIndexStores;
+        }
+        inline bool hasFunctions() {
+            return _hasFunctions;
+        }
+        inline bool hasReturns() {
+            return _hasReturns;
+        }
+        inline bool hasLoopExits() {
+            return _hasLoopExits;
+        }
+        inline bool hasLoops() {
+            return _hasLoops;
+        }
+        inline bool hasDivisions() {
+            return _hasDivisions;
+        }
+        inline bool hasShortCircuits() {
+            return _hasShortCircuits;
+        }
+        inline size_t nodes() {
+            return _nodes;
+        }
+
+        /** True if evaluating the subtree has no observable effect. */
+        inline bool pure() {
+            return _assigned.empty() && !_hasCalls && !_hasIO && !_hasAllocs && !_hasIndexStores;
+        }
+
+    public:
+    // do not edit these lines
+#define __IN_VISITOR_HEADER__
+#include ".auto/visitor_decls.h"      // automatically generated
+#undef __IN_VISITOR_HEADER__
+    // do not edit these lines: end
+
+    };
+
+} // til
+
+#endif
@@ -0,0 +1,301 @@
+#include <algorithm>
+#include "targets/escape_analyser.h"
+#include "targets/counted_loop.h"
+#include "targets/options.h"
+#include ".auto/all_nodes.h"
+
+bool til::escape_analyser::local(til::alloc_node *node) {
+  auto binding = _bound.find(node);
+  return binding != _bound.end() && !_escaping.count(binding->second);
+}
+
+bool til::escape_analyser::allLocal() {
+  if (!_unbound.empty() || _bound.empty()) {
+    return false;
+  }
+  return std::all_of(_bound.begin(), _bound.end(), [this](auto &binding) { return local(binding.first); });
+}
+
+/*
+ * The slot must have the same size whenever the block is visited, so only
+ * typed allocations of a literal number of objects qualify. Checked mode
+ * keeps the 8-byte size header in the slot as well.
+*/
+std::optional<size_t> til::escape_analyser::fixedSize(til::alloc_node *node, size_t limit) {
+  auto declaration = _declarations.find(node);
+  if (declaration == _declarations.end() || !_ownDeclarations.count(declaration->second) || !local(node)) {
+    return std::nullopt;
+  }
+
+  auto count = dynamic_cast<cdk::integer_node*>(node->argument());
+  auto type = cdk::reference_type::cast(node->type());
+  if (count == nullptr || count->value() <= 0 || type == nullptr || type->referenced() == nullptr) {
+    return std::nullopt;
+  }
+
+  size_t bytes = count->value() * std::max(static_cast<size_t>(1), type->referenced()->size());
+  if (bytes > limit) {
+    return std::nullopt;
+  }
+  return bytes + (options::checked() ? 8 : 0);
+}
+
+std::vector<til::alloc_node*> til::escape_analyser::ownAllocations() {
+  std::vector<til::alloc_node*> allocations;
+  for (auto &declaration : _declarations) {
+    if (_ownDeclarations.count(declaration.second)) allocations.push_back(declaration.first);
+  }
+  return allocations;
+}
+
+std::vector<til::alloc_node*> til::escape_analyser::allocations() {
+  std::vector<til::alloc_node*> allocations(_unbound.begin(), _unbound.end());
+  for (auto &binding : _bound) {
+    allocations.push_back(binding.first);
+  }
+  return allocations;
+}
+
+//---------------------------------------------------------------------------
+
+void til::escape_analyser::do_sequence_node(cdk::sequence_node *const node, int lvl) {
+  for (size_t i = 0; i < node->size(); i++) {
+    node->node(i)->accept(this, lvl);
+  }
+}
+
+//---------------------------------------------------------------------------
+
+void til::escape_analyser::do_nil_node(cdk::nil_node * const node, int lvl) {
+  // EMPTY
+}
+
+void til::escape_analyser::do_data_node(cdk::data_node * const node, int lvl) {
+  // EMPTY
+}
+
+void til::escape_analyser::do_integer_node(cdk::integer_node * const node, int lvl) {
+  // EMPTY
+}
+
+void til::escape_analyser::do_double_node(cdk::double_node * const node, int lvl) {
+  // EMPTY
+}
+
+void til::escape_analyser::do_string_node(cdk::string_node * const node, int lvl) {
+  // EMPTY
+}
+
+//---------------------------------------------------------------------------
+
+void til::escape_analyser::do_unary_minus_node(cdk::unary_minus_node * const node, int lvl) {
+  node->argument()->accept(this, lvl);
+}
+
+void til::escape_analyser::do_unary_plus_node(cdk::unary_plus_node * const node, int lvl) {
+  node->argument()->accept(this, lvl);
+}
+
+void til::escape_analyser::do_not_node(cdk::not_node * const node, int lvl) {
+  node->argument()->accept(this, lvl);
+}
+
+void til::escape_analyser::do_add_node(cdk::add_node * const node, int lvl) {
+  node->left()->accept(this, lvl);
+  node->right()->accept(this, lvl);
+}
+
+void til::escape_analyser::do_sub_node(cdk::sub_node * const node, int lvl) {
+  node->left()->accept(this, lvl);
+  node->right()->accept(this, lvl);
+}
+
+void til::escape_analyser::do_mul_node(cdk::mul_node * const node, int lvl) {
+  node->left()->accept(this, lvl);
+  node->right()->accept(this, lvl);
+}
+
+void til::escape_analyser::do_div_node(cdk::div_node * const node, int lvl) {
+  node->left()->accept(this, lvl);
+  node->right()->accept(this, lvl);
+}
+
+void til::escape_analyser::do_mod_node(cdk::mod_node * const node, int lvl) {
+  node->left()->accept(this, lvl);
+  node->right()->accept(this, lvl);
+}
+
+void til::escape_analyser::do_lt_node(cdk::lt_node * const node, int lvl) {
+  node->left()->accept(this, lvl);
+  node->right()->accept(this, lvl);
+}
+
+void til::escape_analyser::do_le_node(cdk::le_node * const node, int lvl) {
+  node->left()->accept(this, lvl);
+  node->right()->accept(this, lvl);
+}
+
+void til::escape_analyser::do_ge_node(cdk::ge_node * const node, int lvl) {
+  node->left()->accept(this, lvl);
+  node->right()->accept(this, lvl);
+}
+
+void til::escape_analyser::do_gt_node(cdk::gt_node * const node, int lvl) {
+  node->left()->accept(this, lvl);
+  node->right()->accept(this, lvl);
+}
+
+void til::escape_analyser::do_ne_node(cdk::ne_node * const node, int lvl) {
+  node->left()->accept(this, lvl);
+  node->right()->accept(this, lvl);
+}
+
+void til::escape_analyser::do_eq_node(cdk::eq_node * const node, int lvl) {
+  node->left()->accept(this, lvl);
+  node->right()->accept(this, lvl);
+}
+
+void til::escape_analyser::do_and_node(cdk::and_node * const node, int lvl) {
+  node->left()->accept(this, lvl);
+  node->right()->accept(this, lvl);
+}
+
+void til::escape_analyser::do_or_node(cdk::or_node * const node, int lvl) {
+  node->left()->accept(this, lvl);
+  node->right()->accept(this, lvl);
+}
+
+//---------------------------------------------------------------------------
+
+void til::escape_analyser::do_variable_node(cdk::variable_node * const node, int lvl) {
+  // EMPTY
+}
+
+void til::escape_analyser::do_rvalue_node(cdk::rvalue_node * const node, int lvl) {
+  if (auto var = dynamic_cast<cdk::variable_node*>(node->lvalue())) {
+    _escaping.insert(var->name()); // the pointer is copied somewhere
+  }
+  node->lvalue()->accept(this, lvl);
+}
+
+void til::escape_analyser::do_assignment_node(cdk::assignment_node * const node, int lvl) {
+  node->lvalue()->accept(this, lvl);
+  node->rvalue()->accept(this, lvl);
+}
+
+//---------------------------------------------------------------------------
+
+void til::escape_analyser::do_evaluation_node(til::evaluation_node * const node, int lvl) {
+  node->argument()->accept(this, lvl);
+}
+
+void til::escape_analyser::do_print_node(til::print_node * const node, int lvl) {
+  node->arguments()->accept(this, lvl);
+}
+
+void til::escape_analyser::do_read_node(til::read_node * const node, int lvl) {
+  // EMPTY
+}
+
+//---------------------------------------------------------------------------
+
+void til::escape_analyser::do_if_node(til::if_node * const node, int lvl) {
+  node->condition()->accept(this, lvl);
+  node->block()->accept(this, lvl);
+}
+
+void til::escape_analyser::do_if_else_node(til::if_else_node * const node, int lvl) {
+  node->condition()->accept(this, lvl);
+  node->thenblock()->accept(this, lvl);
+  node->elseblock()->accept(this, lvl);
+}
+
+//---------------------------------------------------------------------------
+
+void til::escape_analyser::do_alloc_node(til::alloc_node * const node, int lvl) {
+  _unbound.insert(node); // declarations handle their own initializers
+  node->argument()->accept(this, lvl);
+}
+
+void til::escape_analyser::do_address_of_node(til::address_of_node * const node, int lvl) {
+  if (auto var = dynamic_cast<cdk::variable_node*>(node->lvalue())) {
+    _escaping.insert(var->name());
+  } else if (auto index = dynamic_cast<til::index_node*>(node->lvalue())) {
+    // (? (index a i)) points inside a
+    if (auto name = counted_loop::readVariable(index->pointer())) _escaping.insert(*name);
+  }
+  node->lvalue()->accept(this, lvl);
+}
+
+void til::escape_analyser::do_index_node(til::index_node * const node, int lvl) {
+  // the base of index is only dereferenced
+  if (auto rvalue = dynamic_cast<cdk::rvalue_node*>(node->pointer())) {
+    rvalue->lvalue()->accept(this, lvl);
+  } else {
+    node->pointer()->accept(this, lvl);
+  }
+  node->index()->accept(this, lvl);
+}
+
+void til::escape_analyser::do_nullptr_node(til::nullptr_node * const node, int lvl) {
+  // EMPTY
+}
+
+void til::escape_analyser::do_sizeof_node(til::sizeof_node * const node, int lvl) {
+  // EMPTY: the argument is not evaluated
+}
+
+//---------------------------------------------------------------------------
+
+void til::escape_analyser::do_block_node(til::block_node * const node, int lvl) {
+  _blockDepth++;
+  node->declarations()->accept(this, lvl);
+  node->instructions()->accept(this, lvl);
+  _blockDepth--;
+}
+
+void til::escape_analyser::do_declaration_node(til::declaration_node * const node, int lvl) {
+  if (_blockDepth == 1) {
+    _ownDeclarations.insert(node);
+  }
+
+  if (auto alloc = dynamic_cast<til::alloc_node*>(node->initializer())) {
+    _bound[alloc] = node->identifier();
+    _declarations[alloc] = node;
+    alloc->argument()->accept(this, lvl);
+  } else if (node->initializer() != nullptr) {
+    node->initializer()->accept(this, lvl);
+  }
+}
+
+void til::escape_analyser::do_function_node(til::function_node * const node, int lvl) {
+  // EMPTY: the body allocates in its own frame
+}
+
+void til::escape_analyser::do_function_call_node(til::function_call_node * const node, int lvl) {
+  if (node->func() != nullptr) {
+    node->func()->accept(this, lvl);
+  }
+  node->args()->accept(this, lvl);
+}
+
+void til::escape_analyser::do_return_node(til::return_node * const node, int lvl) {
+  if (node->retValue() != nullptr) {
+    node->retValue()->accept(this, lvl);
+  }
+}
+
+//---------------------------------------------------------------------------
+
+void til::escape_analyser::do_loop_node(til::loop_node * const node, int lvl) {
+  node->condition()->accept(this, lvl);
+  node->block()->accept(this, lvl);
+}
+
+void til::escape_analyser::do_next_node(til::next_node * const node, int lvl) {
+  // EMPTY
+}
+
+void til::escape_analyser::do_stop_node(til::stop_node * const node, int lvl) {
+  // EMPTY
+}
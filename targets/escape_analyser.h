@@ -0,0 +1,67 @@
+#ifndef __TIL_TARGETS_ESCAPE_ANALYSER_H__
+#define __TIL_TARGETS_ESCAPE_ANALYSER_H__
+
+#include "targets/basic_ast_visitor.h"
+#include <map>
+#include <optional>
+#include <set>
+#include <vector>
+
+namespace til {
+
+    /**
+     * Finds the objects allocations of a block that cannot outlive it. An
+     * allocation stays in the block when it initializes a variable declared
+     * there that is only ever used as the base of index (never copied,
+     * passed, returned, compared or used with ?). Nested function literals
+     * are not entered: their allocations belong to their own frames.
+     */
+    class escape_analyser: public basic_ast_visitor {
+        std::map<til::alloc_node*, std::string> _bound; // allocations initializing a declared variable
+        std::map<til::alloc_node*, til::declaration_node*> _declarations; // ... and their declarations
+        std::set<til::alloc_node*> _unbound; // allocations used in any other way
+        std::set<std::string> _escaping; // variables used other than as the base of index
+        std::set<til::declaration_node*> _ownDeclarations; // declarations of the analysed block itself
+        int _blockDepth = 0;
+
+    public:
+        escape_analyser(std::shared_ptr<cdk::compiler> compiler) :
+            basic_ast_visitor(compiler) {
+        }
+
+    public:
+        ~escape_analyser() {
+            os().flush();
+        }
+
+    public:
+        /** True if the allocation cannot be reached once the analysed block ends. */
+        bool local(til::alloc_node *node);
+
+        /** True if the subtree allocates and all its allocations are local. */
+        bool allLocal();
+
+        /**
+         * Bytes of a frame slot that can replace an allocation declared by the
+         * analysed block itself: local, with a literal size of at most limit.
+         */
+        std::optional<size_t> fixedSize(til::alloc_node *node, size_t limit);
+
+        /** Allocations initializing the analysed block's own declarations. */
+        std::vector<til::alloc_node*> ownAllocations();
+
+        /** Every allocation in the subtree. */
+        std::vector<til::alloc_node*> allocations();
+
+    public:
+    // do not edit these lines
+#define __IN_VISITOR_HEADER__
+#include ".auto/visitor_decls.h"      // automatically generated
+#undef __IN_VISITOR_HEADER__
+    // do not edit these lines: end
+
+    };
+
+} // til
+
+#endif
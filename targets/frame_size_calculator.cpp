@@ -1,5 +1,9 @@
 #include "targets/frame_size_calculator.h"
 #include "targets/type_checker.h"
+#include "targets/counted_loop.h"
+#include "targets/alias_analysis.h"
+#include "targets/escape_analyser.h"
+#include "targets/options.h"
 #include ".auto/all_nodes.h"
 
 void til::frame_size_calculator::do_sequence_node(cdk::sequence_node *const node, int lvl) {
@@ -20,6 +24,20 @@ void til::frame_size_calculator::do_if_else_node(til::if_else_node *const node,
 void til::frame_size_calculator::do_block_node(til::block_node *const node, int lvl) {
   _symtab.push();
   if (node->declarations()) node->declarations()->accept(this, lvl);
+
+  // same decisions as the writer, now that the declarations are typed
+  til::escape_analyser escapes(_compiler);
+  node->accept(&escapes, lvl);
+  bool dynamic = false;
+  for (auto alloc : escapes.ownAllocations()) {
+    if (auto bytes = escapes.fixedSize(alloc, options::allocSlotLimit())) {
+      _localsize += *bytes;
+    } else {
+      dynamic = true;
+    }
+  }
+  if (dynamic && escapes.allLocal()) _localsize += 4; // saved stack pointer
+
   if (node->instructions()) node->instructions()->accept(this, lvl);
   _symtab.pop();
 }
@@ -30,6 +48,19 @@ void til::frame_size_calculator::do_declaration_node(til::declaration_node *cons
 }
 
 void til::frame_size_calculator::do_loop_node(til::loop_node * const node, int lvl) {
+  // the writer may keep a pointer per derived access, plus two end pointers
+  if (auto loop = til::counted_loop::recognise(_compiler, node); loop && !loop->derivedPointers().empty()) {
+    _localsize += 4 * (loop->derivedPointers().size() + 2);
+  }
+
+  // ... and a slot per hoisted load (of an array element or a global)
+  size_t loads = 0;
+  for (auto rvalue : til::alias_analysis::everyIteration(node)) {
+    auto var = dynamic_cast<cdk::variable_node*>(rvalue->lvalue());
+    auto symbol = var ? _symtab.find(var->name()) : nullptr;
+    if (dynamic_cast<til::index_node*>(rvalue->lvalue()) || (symbol != nullptr && symbol->global())) loads++;
+  }
+  _localsize += 8 * std::min(loads, static_cast<size_t>(std::max(0, options::hoistLoads())));
   node->block()->accept(this, lvl);
 }
 
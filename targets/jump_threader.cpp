@@ -0,0 +1,266 @@
+#include <sstream>
+#include "targets/jump_threader.h"
+
+const std::regex til::jump_threader::identifier("[A-Za-z_.$?][A-Za-z0-9_.$@?#~]*");
+const std::regex til::jump_threader::labelDefinition("([A-Za-z_.$?][A-Za-z0-9_.$@?#~]*):");
+const std::regex til::jump_threader::generatedLabel("_L[0-9]+");
+
+static const std::set<std::string> directives = { "align", "alignb", "global", "extern", "bits", "cpu" };
+static const std::set<std::string> data = { "db", "dw", "dd", "dq", "dt", "resb", "resw", "resd", "resq", "times", "equ" };
+static const std::set<std::string> sizes = { "near", "short", "dword" };
+
+/*
+ * Removes the comment (outside quotes) and surrounding blanks of a line.
+*/
+std::string til::jump_threader::statement(const std::string &text) {
+  char quote = 0;
+  size_t end = text.size();
+  for (size_t k = 0; k < text.size(); k++) {
+    if (quote != 0) {
+      if (text[k] == quote) quote = 0;
+    } else if (text[k] == '"' || text[k] == '\'' || text[k] == '`') {
+      quote = text[k];
+    } else if (text[k] == ';') {
+      end = k;
+      break;
+    }
+  }
+  auto first = text.find_first_not_of(" \t\r");
+  auto last = text.find_last_not_of(" \t\r", end == 0 ? 0 : end - 1);
+  return first == std::string::npos || first >= end ? "" : text.substr(first, last - first + 1);
+}
+
+/*
+ * Splits a statement into words, dropping the commas after operands.
+*/
+std::vector<std::string> til::jump_threader::tokens(const std::string &statement) {
+  std::istringstream words(statement);
+  std::vector<std::string> result;
+  for (std::string word; words >> word;) {
+    if (word.back() == ',') word.pop_back();
+    result.push_back(word);
+  }
+  return result;
+}
+
+/*
+ * Tells whether a segment or section directive starts a text section
+ * (.text, exactly), and nothing for any other statement.
+*/
+std::optional<bool> til::jump_threader::section(const std::vector<std::string> &tokens) {
+  if (tokens.empty() || (tokens[0] != "segment" && tokens[0] != "section")) {
+    return std::nullopt;
+  }
+  return tokens.size() > 1 && tokens[1] == ".text";
+}
+
+til::jump_threader::jump_threader(const std::string &assembly) {
+  std::istringstream input(assembly);
+  std::string text;
+  bool code = false;
+  while (std::getline(input, text)) {
+    line current = { text, INSTRUCTION, code, "", "" };
+    auto body = statement(text);
+
+    auto words = tokens(body);
+
+    std::smatch match;
+    if (words.empty()) {
+      current.what = EMPTY;
+    } else if (std::regex_match(body, match, labelDefinition)) {
+      current.what = LABEL;
+      current.label = match[1];
+    } else {
+      current.mnemonic = words[0];
+      std::vector<std::string> operands;
+      for (size_t k = 1; k < words.size(); k++) {
+        if (!sizes.count(words[k])) operands.push_back(words[k]);
+      }
+      bool direct = operands.size() == 1 && std::regex_match(operands[0], identifier);
+
+      if (auto textSection = section(words)) {
+        current.what = BARRIER;
+        code = *textSection;
+      } else if (directives.count(words[0])) {
+        current.what = DIRECTIVE;
+      } else if (data.count(words[0]) || body.find(':') != std::string::npos) {
+        current.what = BARRIER; // data, or a label with an instruction
+      } else if (words[0] == "jmp") {
+        current.what = direct ? JUMP : EXIT;
+      } else if (words[0][0] == 'j' && direct) {
+        current.what = BRANCH;
+      } else if (words[0] == "ret" || words[0] == "retn") {
+        current.what = EXIT;
+      }
+      if (direct && (current.what == JUMP || current.what == BRANCH)) {
+        current.label = operands[0];
+      }
+    }
+    current.code = code && current.what != BARRIER;
+
+    // anything but a label definition or a direct jump takes the address of the labels it names
+    if (current.what != LABEL && current.what != JUMP && current.what != BRANCH) {
+      for (std::sregex_iterator it(body.begin(), body.end(), identifier), end; it != end; ++it) {
+        auto name = it->str();
+        _addressTaken.insert(name[0] == '$' ? name.substr(1) : name);
+      }
+    }
+    _lines.push_back(current);
+  }
+}
+
+void til::jump_threader::analyse() {
+  _definitions.clear();
+  _jumps.clear();
+  for (size_t k = 0; k < _lines.size(); k++) {
+    auto &current = _lines[k];
+    if (current.removed || !current.code) continue;
+    if (current.what == LABEL) {
+      _definitions[current.label] = k;
+    } else if (current.what == JUMP || current.what == BRANCH) {
+      _jumps[current.label]++;
+    }
+  }
+}
+
+/*
+ * The first line after from that executes (or a barrier), if any.
+*/
+size_t til::jump_threader::nextInstruction(size_t from) const {
+  for (size_t k = from + 1; k < _lines.size(); k++) {
+    auto &current = _lines[k];
+    if (!current.removed && current.what != LABEL && current.what != DIRECTIVE && current.what != EMPTY) {
+      return k;
+    }
+  }
+  return _lines.size();
+}
+
+void til::jump_threader::retarget(line &jump, const std::string &target) {
+  auto position = jump.text.rfind(jump.label);
+  jump.text.replace(position, jump.label.size(), target);
+  jump.label = target;
+}
+
+bool til::jump_threader::thread() {
+  bool changed = false;
+  for (auto &current : _lines) {
+    if (current.removed || !current.code || (current.what != JUMP && current.what != BRANCH)
+        || !std::regex_match(current.label, generatedLabel) || !_definitions.count(current.label)) {
+      continue;
+    }
+
+    // follow jumps to jumps (a cycle of them stays as it is)
+    auto target = current.label;
+    std::set<std::string> visited = { target };
+    size_t next = nextInstruction(_definitions.at(target));
+    while (next < _lines.size() && _lines[next].what == JUMP && _lines[next].code
+           && std::regex_match(_lines[next].label, generatedLabel) && _definitions.count(_lines[next].label)
+           && visited.insert(_lines[next].label).second) {
+      target = _lines[next].label;
+      next = nextInstruction(_definitions.at(target));
+    }
+    if (target != current.label) {
+      retarget(current, target);
+      changed = true;
+    }
+
+    // the epilogue is shorter than a jump to it
+    if (current.what == JUMP && next < _lines.size() && _lines[next].mnemonic == "leave") {
+      auto after = nextInstruction(next);
+      if (after < _lines.size() && _lines[after].mnemonic == "ret" && _lines[after].text.find_first_of(",0123456789") == std::string::npos) {
+        current.text = "\tleave\n\tret";
+        current.what = EXIT;
+        current.mnemonic = "ret";
+        current.label.clear();
+        changed = true;
+      }
+    }
+  }
+  return changed;
+}
+
+bool til::jump_threader::dropJumpsToNext() {
+  bool changed = false;
+  for (size_t k = 0; k < _lines.size(); k++) {
+    auto &current = _lines[k];
+    if (current.removed || !current.code || (current.what != JUMP && current.what != BRANCH)) {
+      continue;
+    }
+    for (size_t next = k + 1; next < _lines.size(); next++) {
+      auto &following = _lines[next];
+      if (following.removed || following.what == EMPTY || following.what == DIRECTIVE) {
+        continue;
+      } else if (following.what == LABEL && following.label == current.label) {
+        current.removed = changed = true;
+      } else if (following.what == LABEL) {
+        continue;
+      }
+      break;
+    }
+  }
+  return changed;
+}
+
+bool til::jump_threader::dropUnreachable() {
+  bool changed = false;
+  for (size_t k = 0; k < _lines.size(); k++) {
+    auto &current = _lines[k];
+    if (current.removed || !current.code || (current.what != JUMP && current.what != EXIT)) {
+      continue;
+    }
+    for (size_t next = k + 1; next < _lines.size(); next++) {
+      auto &following = _lines[next];
+      if (following.removed || following.what == EMPTY || following.what == DIRECTIVE) {
+        continue;
+      } else if (following.what == BARRIER || !following.code) {
+        break;
+      } else if (following.what == LABEL) {
+        if (!std::regex_match(following.label, generatedLabel) || _jumps.count(following.label)
+            || _addressTaken.count(following.label)) {
+          break;
+        }
+        following.removed = changed = true;
+      } else {
+        following.removed = changed = true;
+      }
+    }
+  }
+  return changed;
+}
+
+bool til::jump_threader::dropLabels() {
+  bool changed = false;
+  for (auto &current : _lines) {
+    if (!current.removed && current.code && current.what == LABEL && std::regex_match(current.label, generatedLabel)
+        && !_jumps.count(current.label) && !_addressTaken.count(current.label)) {
+      current.removed = changed = true;
+    }
+  }
+  return changed;
+}
+
+std::string til::jump_threader::str() const {
+  std::ostringstream output;
+  for (auto &current : _lines) {
+    if (!current.removed) output << current.text << std::endl;
+  }
+  return output.str();
+}
+
+std::string til::jump_threader::optimise(const std::string &assembly) {
+  jump_threader threader(assembly);
+  bool changed = true;
+  for (int round = 0; changed && round < 16; round++) {
+    changed = false;
+    threader.analyse();
+    changed |= threader.thread();
+    threader.analyse();
+    changed |= threader.dropJumpsToNext();
+    threader.analyse();
+    changed |= threader.dropUnreachable();
+    threader.analyse();
+    changed |= threader.dropLabels();
+  }
+  return threader.str();
+}
@@ -0,0 +1,79 @@
+#ifndef __TIL_TARGETS_JUMP_THREADER_H__
+#define __TIL_TARGETS_JUMP_THREADER_H__
+
+#include <map>
+#include <optional>
+#include <regex>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace til {
+
+  /**
+   * Simplifies the control flow of the generated assembly, one text
+   * section at a time. Each generated construct brings its own labels and
+   * jumps, so nested constructs leave jumps to jumps, jumps to the next
+   * instruction and code nothing can reach. This pass:
+   *
+   *   - threads jumps whose target is an unconditional jump;
+   *   - replaces jumps to a bare "leave; ret" epilogue with a copy of it;
+   *   - drops jumps to the instruction that follows them;
+   *   - drops code after an unconditional jump or return, up to a label
+   *     something still refers to;
+   *   - drops labels nothing refers to, merging the blocks around them.
+   *
+   * Only labels of the form _L<n> are touched. A label that appears
+   * anywhere other than as the target of a direct jump (data, calls,
+   * pushes, global declarations, jump tables) is left in place.
+   */
+  class jump_threader {
+    // BRANCH: conditional jump; EXIT: ret or indirect jump; DIRECTIVE: does not
+    // execute (align, global, ...); BARRIER: section changes and anything not understood
+    enum kind { INSTRUCTION, LABEL, JUMP, BRANCH, EXIT, DIRECTIVE, BARRIER, EMPTY };
+
+    struct line {
+      std::string text;
+      kind what;
+      bool code; // in a text section
+      std::string mnemonic;
+      std::string label; // defined (LABEL) or target (JUMP and BRANCH)
+      bool removed = false;
+    };
+
+    std::vector<line> _lines;
+    std::map<std::string, size_t> _definitions; // code labels and their lines
+    std::map<std::string, size_t> _jumps; // direct jumps to each label
+    std::set<std::string> _addressTaken; // labels used other than as direct jump targets
+
+    jump_threader(const std::string &assembly);
+
+    void analyse();
+    size_t nextInstruction(size_t from) const;
+    bool thread();
+    bool dropJumpsToNext();
+    bool dropUnreachable();
+    bool dropLabels();
+    void retarget(line &jump, const std::string &target);
+    std::string str() const;
+
+  public:
+    static std::string optimise(const std::string &assembly);
+
+    /** The text of a line without its comment and surrounding blanks. */
+    static std::string statement(const std::string &text);
+
+    /** The words of a statement, without the commas between operands. */
+    static std::vector<std::string> tokens(const std::string &statement);
+
+    /** For a section directive, whether it starts a text section (nothing for other statements). */
+    static std::optional<bool> section(const std::vector<std::string> &tokens);
+
+    /** NASM identifiers, label definitions (the name is captured) and generated labels (_L<n>). */
+    static const std::regex identifier, labelDefinition, generatedLabel;
+
+  };
+
+} // til
+
+#endif
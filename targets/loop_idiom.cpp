@@ -0,0 +1,112 @@
+#include "targets/loop_idiom.h"
+#include ".auto/all_nodes.h"
+
+/*
+ * Checks that node is (index a i) for an array variable a other than i.
+*/
+static til::index_node *indexedByCounter(cdk::basic_node *const node, const std::string &counter) {
+  auto index = dynamic_cast<til::index_node*>(node);
+  if (index == nullptr || til::counted_loop::readVariable(index->index()) != counter) {
+    return nullptr;
+  }
+
+  auto array = til::counted_loop::readVariable(index->pointer());
+  if (!array || *array == counter) {
+    return nullptr;
+  }
+  return index;
+}
+
+/*
+ * Checks that expression is a literal or a variable other than the counter.
+*/
+static bool isLoopInvariant(cdk::expression_node *const expression, const std::string &counter) {
+  if (dynamic_cast<cdk::integer_node*>(expression) || dynamic_cast<cdk::double_node*>(expression)
+      || dynamic_cast<til::nullptr_node*>(expression)) {
+    return true;
+  }
+  auto name = til::counted_loop::readVariable(expression);
+  return name && *name != counter;
+}
+
+std::optional<til::loop_idiom> til::loop_idiom::recognise(std::shared_ptr<cdk::compiler> compiler, til::loop_node *node) {
+  // SEARCH: the whole work is in the condition
+  if (auto condition = dynamic_cast<cdk::and_node*>(node->condition())) {
+    auto limit = dynamic_cast<cdk::lt_node*>(condition->left());
+    auto test = dynamic_cast<cdk::ne_node*>(condition->right());
+    auto counter = limit ? counted_loop::readVariable(limit->left()) : std::nullopt;
+    if (!counter || test == nullptr || !isLoopInvariant(limit->right(), *counter)
+        || dynamic_cast<til::nullptr_node*>(limit->right())) {
+      return std::nullopt;
+    }
+
+    loop_idiom idiom(SEARCH, node);
+    idiom._counterValue = limit->left();
+    idiom._bound = limit->right();
+    if ((idiom._target = indexedByCounter(test->left(), *counter))) {
+      idiom._value = test->right();
+    } else if ((idiom._target = indexedByCounter(test->right(), *counter))) {
+      idiom._value = test->left();
+    } else {
+      return std::nullopt;
+    }
+    if (!isLoopInvariant(idiom._value, *counter)) {
+      return std::nullopt;
+    }
+
+    // the body only increments the counter (alone, or in a block)
+    auto statement = node->block();
+    if (auto body = dynamic_cast<til::block_node*>(statement)) {
+      if (body->declarations()->size() != 0 || body->instructions()->size() != 1) {
+        return std::nullopt;
+      }
+      statement = body->instructions()->node(0);
+    }
+    auto increment = dynamic_cast<til::evaluation_node*>(statement);
+    auto assignment = increment ? dynamic_cast<cdk::assignment_node*>(increment->argument()) : nullptr;
+    auto target = assignment ? dynamic_cast<cdk::variable_node*>(assignment->lvalue()) : nullptr;
+    auto add = assignment ? dynamic_cast<cdk::add_node*>(assignment->rvalue()) : nullptr;
+    if (target == nullptr || target->name() != *counter || add == nullptr) {
+      return std::nullopt;
+    }
+
+    auto left = dynamic_cast<cdk::integer_node*>(add->left());
+    auto right = dynamic_cast<cdk::integer_node*>(add->right());
+    if (!(right && right->value() == 1 && counted_loop::readVariable(add->left()) == *counter)
+        && !(left && left->value() == 1 && counted_loop::readVariable(add->right()) == *counter)) {
+      return std::nullopt;
+    }
+
+    idiom._counterLvalue = target;
+    return idiom;
+  }
+
+  // FILL and COPY: a counted loop with a single store
+  auto loop = counted_loop::recognise(compiler, node);
+  if (!loop || loop->step() != 1 || loop->inclusive() || loop->body()->declarations()->size() != 0
+      || loop->body()->instructions()->size() != 2) {
+    return std::nullopt;
+  }
+
+  auto evaluation = dynamic_cast<til::evaluation_node*>(loop->body()->instructions()->node(0));
+  auto store = evaluation ? dynamic_cast<cdk::assignment_node*>(evaluation->argument()) : nullptr;
+  auto target = store ? indexedByCounter(store->lvalue(), loop->counter()) : nullptr;
+  if (target == nullptr) {
+    return std::nullopt;
+  }
+
+  loop_idiom idiom(FILL, node);
+  if ((idiom._source = indexedByCounter(store->rvalue(), loop->counter()))) {
+    idiom._kind = COPY;
+  } else if (isLoopInvariant(store->rvalue(), loop->counter())) {
+    idiom._value = store->rvalue();
+  } else {
+    return std::nullopt;
+  }
+
+  idiom._counterValue = dynamic_cast<cdk::binary_operation_node*>(node->condition())->left();
+  idiom._counterLvalue = dynamic_cast<cdk::assignment_node*>(loop->increment()->argument())->lvalue();
+  idiom._bound = loop->bound();
+  idiom._target = target;
+  return idiom;
+}
@@ -0,0 +1,68 @@
+#ifndef __TIL_TARGETS_LOOP_IDIOM_H__
+#define __TIL_TARGETS_LOOP_IDIOM_H__
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <cdk/compiler.h>
+#include "targets/counted_loop.h"
+
+namespace til {
+
+  /**
+   * Describes a loop that only fills, copies or searches an array, with a
+   * counter i that steps by 1 towards n:
+   *
+   *   (loop (< i n) (block (set (index a i) v) (set i (+ i 1))))                FILL
+   *   (loop (< i n) (block (set (index a i) (index b i)) (set i (+ i 1))))      COPY
+   *   (loop (and (< i n) (!= (index a i) v)) (set i (+ i 1)))                   SEARCH
+   *
+   * v is a literal or a variable. Recognition is syntactic: callers still
+   * have to check types and variables.
+   */
+  class loop_idiom {
+  public:
+    enum kind { FILL, COPY, SEARCH };
+
+  private:
+    kind _kind;
+    til::loop_node *_loop;
+    cdk::expression_node *_counterValue; // i in (< i n)
+    cdk::lvalue_node *_counterLvalue; // i in the increment
+    cdk::expression_node *_bound;
+    til::index_node *_target; // (index a i)
+    til::index_node *_source; // (index b i), for COPY
+    cdk::expression_node *_value; // v, for FILL and SEARCH
+
+    loop_idiom(kind kind, til::loop_node *loop) :
+        _kind(kind), _loop(loop), _counterValue(nullptr), _counterLvalue(nullptr), _bound(nullptr), _target(nullptr),
+        _source(nullptr), _value(nullptr) {
+    }
+
+  public:
+    static std::optional<loop_idiom> recognise(std::shared_ptr<cdk::compiler> compiler, til::loop_node *node);
+
+  public:
+    kind what() const { return _kind; }
+
+    til::loop_node *loop() const { return _loop; }
+
+    cdk::expression_node *counterValue() const { return _counterValue; }
+
+    cdk::lvalue_node *counterLvalue() const { return _counterLvalue; }
+
+    std::string counter() const { return *counted_loop::readVariable(_counterValue); }
+
+    cdk::expression_node *bound() const { return _bound; }
+
+    til::index_node *target() const { return _target; }
+
+    til::index_node *source() const { return _source; }
+
+    cdk::expression_node *value() const { return _value; }
+
+  };
+
+} // til
+
+#endif
@@ -0,0 +1,186 @@
+#ifndef __TIL_TARGETS_OPTIONS_H__
+#define __TIL_TARGETS_OPTIONS_H__
+
+#include <cstdlib>
+#include <string>
+
+namespace til {
+
+  /**
+   * Tuning knobs for the code generator. The command line belongs to the
+   * CDK driver, so they are read from the environment (once).
+   */
+  class options {
+    static int integer(const char *name, int defaultValue) {
+      const char *value = std::getenv(name);
+      return value == nullptr || *value == '\0' ? defaultValue : std::atoi(value);
+    }
+
+    static std::string text(const char *name) {
+      const char *value = std::getenv(name);
+      return value == nullptr ? "" : value;
+    }
+
+  public:
+    /** TIL_UNROLL_FACTOR: copies of the body in unrolled counted loops (0 or 1 disables). */
+    static int unrollFactor() {
+      static int value = integer("TIL_UNROLL_FACTOR", 4);
+      return value;
+    }
+
+    /** TIL_UNROLL_FULL_LIMIT: largest constant trip count that is fully unrolled. */
+    static int fullUnrollLimit() {
+      static int value = integer("TIL_UNROLL_FULL_LIMIT", 8);
+      return value;
+    }
+
+    /** TIL_UNROLL_MAX_NODES: bodies larger than this (in AST nodes) are not unrolled. */
+    static int unrollMaxNodes() {
+      static int value = integer("TIL_UNROLL_MAX_NODES", 48);
+      return value;
+    }
+
+    /** TIL_CHECKED: record the size of objects allocations and check indices against it. */
+    static int checked() {
+      static int value = integer("TIL_CHECKED", 0);
+      return value;
+    }
+
+    /** TIL_VECTORIZE: use SSE2 for element-wise array loops (0 disables). */
+    static int vectorize() {
+      static int value = integer("TIL_VECTORIZE", 1);
+      return value;
+    }
+
+    /** TIL_VECTORIZE_FP_REDUCTIONS: also vectorize double sums, which changes the order of the additions. */
+    static int vectorizeFloatReductions() {
+      static int value = integer("TIL_VECTORIZE_FP_REDUCTIONS", 0);
+      return value;
+    }
+
+    /** TIL_ALLOC_SLOT_LIMIT: largest non-escaping objects allocation (in bytes) kept in a frame slot. */
+    static int allocSlotLimit() {
+      static int value = integer("TIL_ALLOC_SLOT_LIMIT", 256);
+      return value;
+    }
+
+    /** TIL_HEAP_ALLOC: objects allocations that may outlive their function come from an arena. */
+    static int heapAllocation() {
+      static int value = integer("TIL_HEAP_ALLOC", 0);
+      return value;
+    }
+
+    /** TIL_ARENA_CHUNK: bytes the arena requests from the system at a time. */
+    static int arenaChunk() {
+      static int value = integer("TIL_ARENA_CHUNK", 1 << 20);
+      return value;
+    }
+
+    /** TIL_CTFE_STEPS: statements interpreted to fold a call of a pure function (0 disables). */
+    static int ctfeSteps() {
+      static int value = integer("TIL_CTFE_STEPS", 100000);
+      return value;
+    }
+
+    /** TIL_SPECIALIZE_BUDGET: AST nodes that function clones for constant arguments may add (0 disables). */
+    static int specializeBudget() {
+      static int value = integer("TIL_SPECIALIZE_BUDGET", 1000);
+      return value;
+    }
+
+    /** TIL_SELECT_MAX_NODES: if/else assignments whose two values exceed this (in AST nodes) keep their branches (0 disables). */
+    static int selectMaxNodes() {
+      static int value = integer("TIL_SELECT_MAX_NODES", 8);
+      return value;
+    }
+
+    /** TIL_SWITCH_MIN_CASES: if/else chains comparing a variable with fewer constants keep their tests (0 disables). */
+    static int switchMinCases() {
+      static int value = integer("TIL_SWITCH_MIN_CASES", 4);
+      return value;
+    }
+
+    /** TIL_JUMP_TABLE_DENSITY: percentage of a chain's range its constants must cover for a jump table. */
+    static int jumpTableDensity() {
+      static int value = integer("TIL_JUMP_TABLE_DENSITY", 40);
+      return value;
+    }
+
+    /** TIL_JUMP_THREADING: simplify the jumps and labels of the generated assembly (0 disables). */
+    static int jumpThreading() {
+      static int value = integer("TIL_JUMP_THREADING", 1);
+      return value;
+    }
+
+    /** TIL_FUSE_LOOPS: merge adjacent loops over the same range of a counter (0 disables). */
+    static int fuseLoops() {
+      static int value = integer("TIL_FUSE_LOOPS", 1);
+      return value;
+    }
+
+    /** TIL_FOLD_CODE: share the code of functions that generate identical instructions (0 disables). */
+    static int foldCode() {
+      static int value = integer("TIL_FOLD_CODE", 1);
+      return value;
+    }
+
+    /** TIL_DROP_UNREACHABLE: leave out the private globals and functions the program and public symbols never reach (0 disables). */
+    static int dropUnreachable() {
+      static int value = integer("TIL_DROP_UNREACHABLE", 1);
+      return value;
+    }
+
+    /** TIL_HOIST_LOADS: loop-invariant loads kept in frame slots per loop (0 disables). */
+    static int hoistLoads() {
+      static int value = integer("TIL_HOIST_LOADS", 8);
+      return value;
+    }
+
+    /** TIL_PROMOTE_LOCALS: scalar locals per function kept in registers (at most 3; 0 disables). */
+    static int promoteLocals() {
+      static int value = integer("TIL_PROMOTE_LOCALS", 3);
+      return value;
+    }
+
+    /** TIL_PREFETCH_DISTANCE: iterations ahead that innermost loops prefetch gathers and large strides (0 disables).
+     *  The default is provisional until bench/README.md records the measurements it is derived from. */
+    static int prefetchDistance() {
+      static int value = integer("TIL_PREFETCH_DISTANCE", 16);
+      return value;
+    }
+
+    /** TIL_MAX_THREADS: threads that may share the iterations of independent loops (0 or 1 disables).
+     *  Programs run TIL_THREADS of them (read when they start), and all of them if it is not set. */
+    static int maxThreads() {
+      static int value = integer("TIL_MAX_THREADS", 1);
+      return value;
+    }
+
+    /** TIL_PARALLEL_MIN_TRIP: loops with fewer iterations (at run time) stay in the calling thread. */
+    static int parallelMinTrip() {
+      static int value = integer("TIL_PARALLEL_MIN_TRIP", 4096);
+      return value;
+    }
+
+    /** TIL_PARALLEL_CHUNK: iterations a thread takes from a parallel loop at a time. */
+    static int parallelChunk() {
+      static int value = integer("TIL_PARALLEL_CHUNK", 1024);
+      return value;
+    }
+
+    /** TIL_MEMOIZE: comma-separated names of global functions to memoize (when they are pure). */
+    static bool memoize(const std::string &function) {
+      static std::string value = "," + text("TIL_MEMOIZE") + ",";
+      return value.find("," + function + ",") != std::string::npos;
+    }
+
+    /** TIL_MEMO_ENTRIES: entries in the table of each memoized function (rounded down to a power of 2). */
+    static int memoEntries() {
+      static int value = integer("TIL_MEMO_ENTRIES", 4096);
+      return value;
+    }
+  };
+
+} // til
+
+#endif
@@ -1,9 +1,13 @@
 #ifndef __TIL_TARGETS_POSTFIX_TARGET_H__
 #define __TIL_TARGETS_POSTFIX_TARGET_H__
 
+#include <sstream>
 #include <cdk/targets/basic_target.h>
 #include <cdk/ast/basic_node.h>
 #include "targets/postfix_writer.h"
+#include "targets/jump_threader.h"
+#include "targets/code_folder.h"
+#include "targets/options.h"
 
 #include <cdk/emitters/postfix_ix86_emitter.h>
 
@@ -19,17 +23,29 @@ namespace til {
 
   public:
     bool evaluate(std::shared_ptr<cdk::compiler> compiler) {
-      // this symbol table will be used to check identifiers
-      // during code generation
-      cdk::symbol_table<til::symbol> symtab;
-
-      // this is the backend postfix machine
-      cdk::postfix_ix86_emitter pf(compiler);
-
-      // generate assembly code from the syntax tree
-      postfix_writer writer(compiler, symtab, pf);
-      compiler->ast()->accept(&writer, 0);
-
+      // the assembly is collected first, so that its jumps can be simplified
+      // and identical functions folded
+      std::ostringstream assembly;
+      auto output = compiler->ostream()->rdbuf(assembly.rdbuf());
+      bool functionsCompared;
+
+      {
+        // this symbol table will be used to check identifiers
+        // during code generation
+        cdk::symbol_table<til::symbol> symtab;
+
+        // this is the backend postfix machine
+        cdk::postfix_ix86_emitter pf(compiler);
+
+        // generate assembly code from the syntax tree
+        postfix_writer writer(compiler, symtab, pf);
+        compiler->ast()->accept(&writer, 0);
+        functionsCompared = writer.functionsCompared();
+      }
+
+      compiler->ostream()->rdbuf(output);
+      auto code = options::jumpThreading() ? jump_threader::optimise(assembly.str()) : assembly.str();
+      *compiler->ostream() << (options::foldCode() ? code_folder::optimise(code, functionsCompared) : code);
       return true;
     }
 
@@ -1,8 +1,14 @@
 #include <string>
 #include <sstream>
+#include <algorithm>
+#include <limits>
+#include <cmath>
 #include "targets/type_checker.h"
 #include "targets/postfix_writer.h"
 #include "targets/frame_size_calculator.h"
+#include "targets/effect_analyser.h"
+#include "targets/escape_analyser.h"
+#include "targets/options.h"
 #include ".auto/all_nodes.h"  // all_nodes.h is automatically generated
 
 #include "til_parser.tab.h"
@@ -78,6 +84,7 @@ void til::postfix_writer::wrapFunction(int lineno, std::shared_ptr<cdk::basic_ty
   _pf.ALIGN();
 
   auto aux_global_assignment = new cdk::assignment_node(lineno, aux_global_var, node);
+  _valueDiscarded = true;
   aux_global_assignment->accept(this, lvl);
 
   auto aux_global_rvalue = new cdk::rvalue_node(lineno, aux_global_var);
@@ -117,6 +124,34 @@ void til::postfix_writer::do_data_node(cdk::data_node * const node, int lvl) {
 //---------------------------------------------------------------------------
 
 void til::postfix_writer::do_sequence_node(cdk::sequence_node * const node, int lvl) {
+  if (!_moduleAnalysed) {
+    // the first sequence is the whole module: find the globals that never change
+    _moduleAnalysed = true;
+    if (options::dropUnreachable()) findDeadGlobals(node);
+    effect_analyser module(_compiler, true);
+    for (size_t i = 0; i < node->size(); i++) {
+      // what code nothing reaches would do does not count
+      auto declaration = dynamic_cast<til::declaration_node*>(node->node(i));
+      if (declaration == nullptr || !_deadGlobals.count(declaration->identifier())) node->node(i)->accept(&module, lvl);
+    }
+    _moduleAssigned = module.assigned();
+    _moduleAssigned.insert(module.addressTaken().begin(), module.addressTaken().end());
+    _moduleAddressTaken = module.addressTaken();
+
+    // ... and the literal arguments functions are called with
+    for (auto &call : module.calls()) {
+      auto callee = dynamic_cast<cdk::rvalue_node*>(call.first->func());
+      auto name = callee ? dynamic_cast<cdk::variable_node*>(callee->lvalue()) : nullptr;
+      auto arguments = literalArguments(call.first);
+      if (name != nullptr && std::any_of(arguments.begin(), arguments.end(), [](auto &a) { return a.has_value(); })) {
+        _callPatterns[name->name()][arguments] += call.second > 0 ? 10 : 1; // calls in loops weigh more
+      }
+    }
+    _specializationBudget = std::max(0, options::specializeBudget());
+    analyseConventions(node, module);
+    if (options::checked()) findHeaderlessPointers(node, module);
+  }
+
   for (size_t i = 0; i < node->size(); i++) {
     node->node(i)->accept(this, lvl);
   }
@@ -293,6 +328,9 @@ void til::postfix_writer::do_mod_node(cdk::mod_node * const node, int lvl) {
 
 void til::postfix_writer::prepareIDBinaryPredicateExpression(cdk::binary_operation_node * const node, int lvl) {
   prepareIDBinaryExpression(node, lvl);
+  if (node->left()->is_typed(cdk::TYPE_FUNCTIONAL) || node->right()->is_typed(cdk::TYPE_FUNCTIONAL)) {
+    _functionsCompared = true;
+  }
 
   if (node->left()->is_typed(cdk::TYPE_DOUBLE) || node->right()->is_typed(cdk::TYPE_DOUBLE)) {
     _pf.DCMP();
@@ -333,7 +371,6 @@ void til::postfix_writer::do_and_node(cdk::and_node * const node, int lvl) {
   _pf.JZ(mklbl(lbl = ++_lbl));
   node->right()->accept(this, lvl);
   _pf.AND();
-  _pf.ALIGN();
   _pf.LABEL(mklbl(lbl));
 }
 void til::postfix_writer::do_or_node(cdk::or_node * const node, int lvl) {
@@ -345,12 +382,120 @@ void til::postfix_writer::do_or_node(cdk::or_node * const node, int lvl) {
   _pf.JNZ(mklbl(lbl = ++_lbl));
   node->right()->accept(this, lvl);
   _pf.OR();
-  _pf.ALIGN();
   _pf.LABEL(mklbl(lbl));
 }
 
 //---------------------------------------------------------------------------
 
+/*
+ * Checks that an expression can only evaluate to 0 or 1.
+*/
+bool til::postfix_writer::isTruthValue(cdk::expression_node * const node) {
+  if (auto literal = dynamic_cast<cdk::integer_node*>(node)) {
+    return literal->value() == 0 || literal->value() == 1;
+  } else if (auto and_node = dynamic_cast<cdk::and_node*>(node)) {
+    return isTruthValue(and_node->left()) && isTruthValue(and_node->right());
+  } else if (auto or_node = dynamic_cast<cdk::or_node*>(node)) {
+    return isTruthValue(or_node->left()) && isTruthValue(or_node->right());
+  }
+  return isInstanceOf<cdk::not_node, cdk::lt_node, cdk::le_node, cdk::gt_node, cdk::ge_node,
+                      cdk::eq_node, cdk::ne_node>(node);
+}
+
+/*
+ * Generates "jumping code" for a condition: control goes to label when the
+ * condition evaluates to jumpIfTrue, and falls through otherwise. No 0/1
+ * value is ever left on the stack.
+ *
+ * The jumps keep the meaning of and/or as values: the result of an "or" is
+ * nonzero exactly when one of its sides is, but an "and" ends with a bitwise
+ * AND, so it is only split into jumps when both of its sides are 0 or 1.
+*/
+void til::postfix_writer::acceptCondition(cdk::expression_node * const node, int lvl,
+            const std::string &label, bool jumpIfTrue) {
+  auto and_node = dynamic_cast<cdk::and_node*>(node);
+  if (and_node != nullptr && isTruthValue(and_node->left()) && isTruthValue(and_node->right())) {
+    if (jumpIfTrue) {
+      // a false left side skips the right side (falls through)
+      int skipLbl = ++_lbl;
+      acceptCondition(and_node->left(), lvl, mklbl(skipLbl), false);
+      acceptCondition(and_node->right(), lvl, label, true);
+      _pf.LABEL(mklbl(skipLbl));
+    } else {
+      acceptCondition(and_node->left(), lvl, label, false);
+      acceptCondition(and_node->right(), lvl, label, false);
+    }
+  } else if (auto or_node = dynamic_cast<cdk::or_node*>(node)) {
+    if (jumpIfTrue) {
+      acceptCondition(or_node->left(), lvl, label, true);
+      acceptCondition(or_node->right(), lvl, label, true);
+    } else {
+      // a true left side skips the right side (falls through)
+      int skipLbl = ++_lbl;
+      acceptCondition(or_node->left(), lvl, mklbl(skipLbl), true);
+      acceptCondition(or_node->right(), lvl, label, false);
+      _pf.LABEL(mklbl(skipLbl));
+    }
+  } else if (auto not_node = dynamic_cast<cdk::not_node*>(node)) {
+    // negation just swaps the targets
+    acceptCondition(not_node->argument(), lvl, label, !jumpIfTrue);
+  } else if (auto int_node = dynamic_cast<cdk::integer_node*>(node)) {
+    // constant condition: either always jump or never jump
+    if ((int_node->value() != 0) == jumpIfTrue) {
+      _pf.JMP(label);
+    }
+  } else if (auto test = _pointerTests.find(node); test != _pointerTests.end()) {
+    // the counter is dead: compare the pointer that replaced it with its end value
+    _pf.LOCAL(test->second.first);
+    _pf.LDINT();
+    _pf.LOCAL(test->second.second);
+    _pf.LDINT();
+    _pf.SUB();
+    _pf.INT(0);
+    jumpOnComparison(node, label, jumpIfTrue);
+  } else if (isInstanceOf<cdk::lt_node, cdk::le_node, cdk::gt_node, cdk::ge_node, cdk::eq_node, cdk::ne_node>(node)) {
+    acceptComparison(dynamic_cast<cdk::binary_operation_node*>(node), lvl, label, jumpIfTrue);
+  } else {
+    node->accept(this, lvl);
+    if (jumpIfTrue) {
+      _pf.JNZ(label);
+    } else {
+      _pf.JZ(label);
+    }
+  }
+}
+
+/*
+ * Lowers a comparison directly to a fused compare-and-branch instruction.
+ * Doubles are compared with DCMP first, so the jump compares its result with 0.
+*/
+void til::postfix_writer::acceptComparison(cdk::binary_operation_node * const node, int lvl,
+            const std::string &label, bool jumpIfTrue) {
+  prepareIDBinaryPredicateExpression(node, lvl);
+  jumpOnComparison(node, label, jumpIfTrue);
+}
+
+/*
+ * Emits the conditional jump for a comparison whose operands are already on the stack.
+*/
+void til::postfix_writer::jumpOnComparison(cdk::expression_node * const node, const std::string &label, bool jumpIfTrue) {
+  if (isInstanceOf<cdk::lt_node>(node)) {
+    if (jumpIfTrue) _pf.JLT(label); else _pf.JGE(label);
+  } else if (isInstanceOf<cdk::le_node>(node)) {
+    if (jumpIfTrue) _pf.JLE(label); else _pf.JGT(label);
+  } else if (isInstanceOf<cdk::gt_node>(node)) {
+    if (jumpIfTrue) _pf.JGT(label); else _pf.JLE(label);
+  } else if (isInstanceOf<cdk::ge_node>(node)) {
+    if (jumpIfTrue) _pf.JGE(label); else _pf.JLT(label);
+  } else if (isInstanceOf<cdk::eq_node>(node)) {
+    if (jumpIfTrue) _pf.JEQ(label); else _pf.JNE(label);
+  } else {
+    if (jumpIfTrue) _pf.JNE(label); else _pf.JEQ(label);
+  }
+}
+
+//---------------------------------------------------------------------------
+
 void til::postfix_writer::do_variable_node(cdk::variable_node * const node, int lvl) {
   ASSERT_SAFE_EXPRESSIONS;
 
@@ -367,6 +512,45 @@ void til::postfix_writer::do_variable_node(cdk::variable_node * const node, int
 
 void til::postfix_writer::do_rvalue_node(cdk::rvalue_node * const node, int lvl) {
   ASSERT_SAFE_EXPRESSIONS;
+
+  // fixed parameter of a clone (their names are not redeclared in it)
+  auto var = dynamic_cast<cdk::variable_node*>(node->lvalue());
+  if (auto fixed = var ? _specializedArguments.find(var->name()) : _specializedArguments.end();
+      fixed != _specializedArguments.end()) {
+    if (node->is_typed(cdk::TYPE_DOUBLE)) {
+      _pf.DOUBLE(constant_evaluator::toDouble(fixed->second));
+    } else {
+      _pf.INT(std::get<int>(fixed->second));
+    }
+    return;
+  }
+
+  // loaded before the loop (see hoistLoads)
+  if (auto hoisted = _hoistedLoads.find(node); hoisted != _hoistedLoads.end()) {
+    _pf.LOCAL(hoisted->second);
+    if (node->is_typed(cdk::TYPE_DOUBLE)) {
+      _pf.LDDOUBLE();
+    } else {
+      _pf.LDINT();
+    }
+    return;
+  }
+
+  // kept in a slot through the loop (see hoistLoads)
+  if (auto index = dynamic_cast<til::index_node*>(node->lvalue())) {
+    if (auto slot = _forwardedElements.find(index); slot != _forwardedElements.end()) {
+      _pf.LOCAL(slot->second);
+      if (node->is_typed(cdk::TYPE_DOUBLE)) _pf.LDDOUBLE(); else _pf.LDINT();
+      return;
+    }
+  }
+
+  // kept in a register (see promoteLocals)
+  if (auto reg = var ? promotedRegister(var->name()) : std::nullopt) {
+    asmInstruction("push " + *reg);
+    return;
+  }
+
   node->lvalue()->accept(this, lvl);
   
   if(_externalFunctionName) {
@@ -381,17 +565,41 @@ void til::postfix_writer::do_rvalue_node(cdk::rvalue_node * const node, int lvl)
 }
 
 void til::postfix_writer::do_assignment_node(cdk::assignment_node * const node, int lvl) {
+  bool valueDiscarded = _valueDiscarded;
+  _valueDiscarded = false;
   ASSERT_SAFE_EXPRESSIONS;
 
   acceptCovariantNode(node->type(), node->rvalue(), lvl);
-  if (node->is_typed(cdk::TYPE_DOUBLE)) {
+  if (valueDiscarded) {
+    // statement-level assignment: only the stored copy is needed
+  } else if (node->is_typed(cdk::TYPE_DOUBLE)) {
     _pf.DUP64();
   } else {
     _pf.DUP32();
   }
 
-  node->lvalue()->accept(this, lvl); // where to store the value
-  if (node->is_typed(cdk::TYPE_DOUBLE)) {
+  storeValue(node->lvalue(), node->is_typed(cdk::TYPE_DOUBLE), lvl);
+}
+
+/*
+ * Pops the value on top of the stack into an lvalue. Locals kept in
+ * registers (see promoteLocals) and elements forwarded through a loop (see
+ * hoistLoads) have no up-to-date copy in memory.
+*/
+void til::postfix_writer::storeValue(cdk::lvalue_node * const lvalue, bool isDouble, int lvl) {
+  auto var = dynamic_cast<cdk::variable_node*>(lvalue);
+  if (auto reg = var ? promotedRegister(var->name()) : std::nullopt) {
+    asmInstruction("pop " + *reg);
+    return;
+  }
+
+  auto index = dynamic_cast<til::index_node*>(lvalue);
+  if (auto slot = index ? _forwardedElements.find(index) : _forwardedElements.end(); slot != _forwardedElements.end()) {
+    _pf.LOCAL(slot->second);
+  } else {
+    lvalue->accept(this, lvl); // where to store the value
+  }
+  if (isDouble) {
     _pf.STDOUBLE(); // store the value at address
   } else {
     _pf.STINT(); // store the value at address
@@ -402,9 +610,50 @@ void til::postfix_writer::do_assignment_node(cdk::assignment_node * const node,
 
 void til::postfix_writer::do_evaluation_node(til::evaluation_node * const node, int lvl) {
   ASSERT_SAFE_EXPRESSIONS;
-  node->argument()->accept(this, lvl); // determine the value
-  if (node->argument()->type()->size() > 0) {
-    _pf.TRASH(node->argument()->type()->size());
+  acceptDiscarded(node->argument(), lvl); // the value is not needed
+}
+
+/*
+ * Generates code for an expression whose value is discarded: assignments
+ * and calls are told not to leave their value on the stack, and parts
+ * without side effects produce no code at all.
+*/
+void til::postfix_writer::acceptDiscarded(cdk::expression_node * const node, int lvl) {
+  if (isInstanceOf<cdk::assignment_node, til::function_call_node>(node)) {
+    _valueDiscarded = true;
+    node->accept(this, lvl);
+    return;
+  }
+
+  effect_analyser analyser(_compiler);
+  node->accept(&analyser, lvl);
+  if (analyser.pure()) {
+    return;
+  }
+
+  if (auto and_node = dynamic_cast<cdk::and_node*>(node)) {
+    // the right side only runs if the left side is true
+    int lbl;
+    acceptCondition(and_node->left(), lvl, mklbl(lbl = ++_lbl), false);
+    acceptDiscarded(and_node->right(), lvl);
+    _pf.LABEL(mklbl(lbl));
+  } else if (auto or_node = dynamic_cast<cdk::or_node*>(node)) {
+    // the right side only runs if the left side is false
+    int lbl;
+    acceptCondition(or_node->left(), lvl, mklbl(lbl = ++_lbl), true);
+    acceptDiscarded(or_node->right(), lvl);
+    _pf.LABEL(mklbl(lbl));
+  } else if (auto unary = dynamic_cast<cdk::unary_operation_node*>(node);
+             unary != nullptr && !isInstanceOf<til::alloc_node>(node)) {
+    acceptDiscarded(unary->argument(), lvl);
+  } else if (auto binary = dynamic_cast<cdk::binary_operation_node*>(node)) {
+    acceptDiscarded(binary->left(), lvl);
+    acceptDiscarded(binary->right(), lvl);
+  } else {
+    node->accept(this, lvl); // determine the value
+    if (node->type()->size() > 0) {
+      _pf.TRASH(node->type()->size());
+    }
   }
 }
 
@@ -455,16 +704,36 @@ void til::postfix_writer::do_read_node(til::read_node * const node, int lvl) {
   }
 }
 
+/*
+ * In a clone, conditions that only depend on its fixed parameters select
+ * one branch at compile time.
+*/
+std::optional<bool> til::postfix_writer::specializedCondition(cdk::expression_node * const condition) {
+  if (_specializedArguments.empty()) {
+    return std::nullopt;
+  }
+  auto value = constant_evaluator::evaluate(_compiler, _specializedArguments, {}, condition);
+  if (!value || !std::holds_alternative<int>(*value)) {
+    return std::nullopt;
+  }
+  return std::get<int>(*value) != 0;
+}
+
 //---------------------------------------------------------------------------
 
 void til::postfix_writer::do_if_node(til::if_node * const node, int lvl) {
   ASSERT_SAFE_EXPRESSIONS;
+
+  if (auto condition = specializedCondition(node->condition())) {
+    if (*condition) node->block()->accept(this, lvl + 2);
+    _visitedFinalInstruction = false;
+    return;
+  }
+
   int lbl1;
-  node->condition()->accept(this, lvl);
-  _pf.JZ(mklbl(lbl1 = ++_lbl));
+  acceptCondition(node->condition(), lvl, mklbl(lbl1 = ++_lbl), false);
   node->block()->accept(this, lvl + 2);
   _visitedFinalInstruction = false;
-  _pf.ALIGN();
   _pf.LABEL(mklbl(lbl1));
 }
 
@@ -472,29 +741,308 @@ void til::postfix_writer::do_if_node(til::if_node * const node, int lvl) {
 
 void til::postfix_writer::do_if_else_node(til::if_else_node * const node, int lvl) {
   ASSERT_SAFE_EXPRESSIONS;
+
+  if (auto condition = specializedCondition(node->condition())) {
+    (*condition ? node->thenblock() : node->elseblock())->accept(this, lvl + 2);
+    _visitedFinalInstruction = false;
+    return;
+  }
+
+  if (selectAssignment(node, lvl) || dispatchChain(node, lvl)) {
+    return;
+  }
+
   int lbl1, lbl2;
-  node->condition()->accept(this, lvl);
-  _pf.JZ(mklbl(lbl1 = ++_lbl));
+  acceptCondition(node->condition(), lvl, mklbl(lbl1 = ++_lbl), false);
   node->thenblock()->accept(this, lvl + 2);
   _visitedFinalInstruction = false;
   _pf.JMP(mklbl(lbl2 = ++_lbl));
-  _pf.ALIGN();
   _pf.LABEL(mklbl(lbl1));
   node->elseblock()->accept(this, lvl + 2);
   _visitedFinalInstruction = false;
-  _pf.ALIGN();
   _pf.LABEL(mklbl(lbl1 = lbl2));
 }
 
+/*
+ * If-conversion: (if c (set x a) (set x b)) on an int or pointer variable
+ * becomes x = c ? a : b, computed with a mask instead of branches. Both
+ * values are computed, so they must be cheap (TIL_SELECT_MAX_NODES) and
+ * unable to fail or have effects: no calls, loads through pointers or
+ * divisions. Conditions with and/or keep their branches.
+*/
+bool til::postfix_writer::selectAssignment(til::if_else_node * const node, int lvl) {
+  auto thenAssignment = singleAssignment(node->thenblock());
+  auto elseAssignment = singleAssignment(node->elseblock());
+  if (thenAssignment == nullptr || elseAssignment == nullptr) {
+    return false;
+  }
+
+  auto thenVariable = dynamic_cast<cdk::variable_node*>(thenAssignment->lvalue());
+  auto elseVariable = dynamic_cast<cdk::variable_node*>(elseAssignment->lvalue());
+  if (thenVariable == nullptr || elseVariable == nullptr || thenVariable->name() != elseVariable->name()) {
+    return false;
+  }
+
+  size_t nodes = 0;
+  for (auto assignment : { thenAssignment, elseAssignment }) {
+    effect_analyser effects(_compiler);
+    assignment->rvalue()->accept(&effects, lvl);
+    if (!effects.pure() || effects.hasDivisions() || !effects.indexes().empty() || effects.hasFunctions()) {
+      return false;
+    }
+    nodes += effects.nodes();
+  }
+  if (nodes > static_cast<size_t>(options::selectMaxNodes())) {
+    return false;
+  }
+
+  // the arms are typed here (errors are reported when they are generated)
+  try {
+    type_checker checker(_compiler, _symtab, this);
+    thenAssignment->accept(&checker, 0);
+    elseAssignment->accept(&checker, 0);
+  } catch (const std::string &) {
+    return false;
+  }
+  if (!node->condition()->is_typed(cdk::TYPE_INT)
+      || (!thenAssignment->is_typed(cdk::TYPE_INT) && !thenAssignment->is_typed(cdk::TYPE_POINTER))) {
+    return false;
+  }
+
+  // the condition goes first: it may change what the values read
+  node->condition()->accept(this, lvl);
+  acceptCovariantNode(thenAssignment->type(), thenAssignment->rvalue(), lvl);
+  acceptCovariantNode(elseAssignment->type(), elseAssignment->rvalue(), lvl);
+  asmInstruction("pop ecx");             // else value
+  asmInstruction("pop edx");             // then value
+  asmInstruction("pop eax");
+  asmInstruction("neg eax");
+  asmInstruction("sbb eax, eax");        // all ones if the condition holds
+  asmInstruction("xor edx, ecx");
+  asmInstruction("and edx, eax");
+  asmInstruction("xor edx, ecx");
+  asmInstruction("push edx");
+  storeValue(thenAssignment->lvalue(), false, lvl);
+  return true;
+}
+
+/*
+ * Chains of tests of one int variable against distinct constants
+ *
+ *   (if (== v 1) A (if (== v 2) B (if (== v 5) C D)))
+ *
+ * read the variable once and jump straight to the matching branch: through
+ * a table in rodata when the constants are dense enough
+ * (TIL_JUMP_TABLE_DENSITY), or else after a binary search of compares.
+ * Repeated constants can never match again and are dropped.
+*/
+bool til::postfix_writer::dispatchChain(til::if_else_node * const node, int lvl) {
+  if (options::switchMinCases() == 0) {
+    return false;
+  }
+
+  cdk::rvalue_node *variable = nullptr;
+  auto caseKey = [&](cdk::expression_node *condition) -> std::optional<int> {
+    auto eq = dynamic_cast<cdk::eq_node*>(condition);
+    if (eq == nullptr) {
+      return std::nullopt;
+    }
+    auto literal = dynamic_cast<cdk::integer_node*>(eq->right());
+    auto rvalue = dynamic_cast<cdk::rvalue_node*>(eq->left());
+    if (literal == nullptr) {
+      literal = dynamic_cast<cdk::integer_node*>(eq->left());
+      rvalue = dynamic_cast<cdk::rvalue_node*>(eq->right());
+    }
+    auto name = counted_loop::readVariable(rvalue);
+    if (literal == nullptr || !name || (variable != nullptr && name != counted_loop::readVariable(variable))) {
+      return std::nullopt;
+    }
+    if (variable == nullptr) variable = rvalue;
+    return literal->value();
+  };
+
+  // (constant, branch) in the order of the tests, and what runs when none matches
+  std::vector<std::pair<int, cdk::basic_node*>> branches;
+  std::set<int> keys;
+  cdk::basic_node *fallback = nullptr;
+  for (cdk::basic_node *link = node; link != nullptr;) {
+    auto instruction = singleInstruction(link);
+    auto ifElse = dynamic_cast<til::if_else_node*>(instruction);
+    auto ifOnly = dynamic_cast<til::if_node*>(instruction);
+    auto key = ifElse ? caseKey(ifElse->condition()) : ifOnly ? caseKey(ifOnly->condition()) : std::nullopt;
+    if (!key) {
+      fallback = link;
+      break;
+    }
+    if (keys.insert(*key).second) {
+      branches.push_back(std::make_pair(*key, ifElse ? ifElse->thenblock() : ifOnly->block()));
+    }
+    link = ifElse ? ifElse->elseblock() : nullptr;
+  }
+  if (branches.size() < static_cast<size_t>(options::switchMinCases())) {
+    return false;
+  }
+
+  auto symbol = _symtab.find(*counted_loop::readVariable(variable));
+  if (symbol == nullptr || !symbol->is_typed(cdk::TYPE_INT) || _specializedArguments.count(symbol->name())) {
+    return false;
+  }
+
+  int defaultLbl = ++_lbl, endLbl = ++_lbl;
+  std::vector<std::pair<int, int>> cases; // (constant, label), sorted
+  for (auto &branch : branches) {
+    cases.push_back(std::make_pair(branch.first, ++_lbl));
+  }
+  std::vector<int> labels;
+  for (auto &c : cases) labels.push_back(c.second);
+  std::sort(cases.begin(), cases.end());
+
+  variable->accept(this, lvl);
+  asmInstruction("pop eax");
+
+  long long range = static_cast<long long>(cases.back().first) - cases.front().first + 1;
+  if (options::jumpTableDensity() > 0 && static_cast<long long>(cases.size()) * 100 >= range * options::jumpTableDensity()) {
+    int tableLbl = ++_lbl;
+    asmInstruction("sub eax, " + std::to_string(cases.front().first));
+    asmInstruction("cmp eax, " + std::to_string(range - 1));
+    asmInstruction("ja " + mklbl(defaultLbl));
+    asmInstruction("jmp dword [" + mklbl(tableLbl) + "+eax*4]");
+
+    _pf.RODATA();
+    _pf.ALIGN();
+    _pf.LABEL(mklbl(tableLbl));
+    auto c = cases.begin();
+    for (long long key = cases.front().first; key <= cases.back().first; key++) {
+      if (key == c->first) {
+        _pf.SADDR(mklbl(c->second));
+        ++c;
+      } else {
+        _pf.SADDR(mklbl(defaultLbl));
+      }
+    }
+    _pf.TEXT(_functionLabels.top());
+  } else {
+    searchCases(cases, 0, cases.size(), defaultLbl);
+  }
+
+  for (size_t k = 0; k < branches.size(); k++) {
+    _pf.LABEL(mklbl(labels[k]));
+    branches[k].second->accept(this, lvl + 2);
+    _visitedFinalInstruction = false;
+    _pf.JMP(mklbl(endLbl));
+  }
+  _pf.LABEL(mklbl(defaultLbl));
+  if (fallback != nullptr) {
+    fallback->accept(this, lvl + 2);
+    _visitedFinalInstruction = false;
+  }
+  _pf.LABEL(mklbl(endLbl));
+  return true;
+}
+
+/*
+ * Binary search for eax among cases[first, last) (sorted by constant).
+*/
+void til::postfix_writer::searchCases(const std::vector<std::pair<int, int>> &cases, size_t first, size_t last,
+            int defaultLbl) {
+  if (last - first <= 3) {
+    for (size_t k = first; k < last; k++) {
+      asmInstruction("cmp eax, " + std::to_string(cases[k].first));
+      asmInstruction("je " + mklbl(cases[k].second));
+    }
+    _pf.JMP(mklbl(defaultLbl));
+    return;
+  }
+
+  size_t middle = (first + last) / 2;
+  int greaterLbl = ++_lbl;
+  asmInstruction("cmp eax, " + std::to_string(cases[middle].first));
+  asmInstruction("je " + mklbl(cases[middle].second));
+  asmInstruction("jg " + mklbl(greaterLbl));
+  searchCases(cases, first, middle, defaultLbl);
+  _pf.LABEL(mklbl(greaterLbl));
+  searchCases(cases, middle + 1, last, defaultLbl);
+}
+
+/*
+ * The instruction a block without declarations consists of (or the node itself).
+*/
+cdk::basic_node *til::postfix_writer::singleInstruction(cdk::basic_node * const node) {
+  auto block = dynamic_cast<til::block_node*>(node);
+  if (block != nullptr && block->declarations()->size() == 0 && block->instructions()->size() == 1) {
+    return singleInstruction(block->instructions()->node(0));
+  }
+  return node;
+}
+
+/*
+ * The assignment that is the only thing an instruction does, if any.
+*/
+cdk::assignment_node *til::postfix_writer::singleAssignment(cdk::basic_node * const node) {
+  auto evaluation = dynamic_cast<til::evaluation_node*>(singleInstruction(node));
+  return evaluation == nullptr ? nullptr : dynamic_cast<cdk::assignment_node*>(evaluation->argument());
+}
+
 //---------------------------------------------------------------------------
 
 void til::postfix_writer::do_alloc_node(til::alloc_node * const node, int lvl) {
   ASSERT_SAFE_EXPRESSIONS;
   
+  if (auto fixed = _fixedAllocations.find(node); fixed != _fixedAllocations.end()) {
+    // a frame slot reserved by the block (the size is a literal)
+    _offset -= fixed->second;
+    if (options::checked()) {
+      _pf.INT(static_cast<int>(fixed->second) - 8);
+      _pf.LOCAL(_offset);
+      _pf.STINT();
+      _pf.INT(checkedArrayTag);
+      _pf.LOCAL(_offset + 4);
+      _pf.STINT();
+      _pf.LOCAL(_offset + 8);
+    } else {
+      _pf.LOCAL(_offset);
+    }
+    return;
+  }
+
   auto ref = cdk::reference_type::cast(node->type())->referenced();
   node->argument()->accept(this, lvl);
   _pf.INT(std::max(static_cast<size_t>(1), ref->size())); //type size
   _pf.MUL();     // type size * argument
+
+  if (_heapAllocations.count(node)) {
+    if (_arenaLbl == 0) _arenaLbl = ++_lbl;
+    if (options::checked()) {
+      _pf.DUP32();  // kept for the header
+      _pf.INT(8);
+      _pf.ADD();
+    }
+    _pf.CALL(mklbl(_arenaLbl));
+    _pf.TRASH(4);
+    _pf.LDFVAL32();
+    if (options::checked()) {
+      asmInstruction("pop eax");
+      asmInstruction("pop ecx");
+      asmInstruction("mov [eax], ecx");
+      asmInstruction("mov dword [eax+4], " + std::to_string(checkedArrayTag));
+      asmInstruction("add eax, 8");
+      asmInstruction("push eax");
+    }
+    return;
+  }
+
+  if (options::checked()) {
+    // 8-byte header before the array: its size in bytes and a tag
+    asmInstruction("pop eax");
+    asmInstruction("lea ecx, [eax+8]");
+    asmInstruction("sub esp, ecx");
+    asmInstruction("mov [esp], eax");
+    asmInstruction("mov dword [esp+4], " + std::to_string(checkedArrayTag));
+    asmInstruction("lea eax, [esp+8]");
+    asmInstruction("push eax");
+    return;
+  }
+
   _pf.ALLOC();   // allocate space for the array
   _pf.SP();      // pushes the array address
 }
@@ -506,14 +1054,144 @@ void til::postfix_writer::do_address_of_node(til::address_of_node * const node,
 
 void til::postfix_writer::do_index_node(til::index_node * const node, int lvl) {
   ASSERT_SAFE_EXPRESSIONS;
+
+  if (auto pointer = _derivedPointers.find(node); pointer != _derivedPointers.end()) {
+    _pf.LOCAL(pointer->second);    // the address is kept up to date by the loop
+    _pf.LDINT();
+    return;
+  }
   
   node->pointer()->accept(this, lvl + 2);
   node->index()->accept(this, lvl + 2);
+  if (needsIndexCheck(node)) {
+    if (_indexFailLbl == 0) _indexFailLbl = ++_lbl;
+    checkIndex(4, 0, node->type()->size(), mklbl(_indexFailLbl));
+  }
   _pf.INT(node->type()->size());   // type size
   _pf.MUL();                       // type size * index
   _pf.ADD();                       // pointer base + (type size * index)
 }
 
+/*
+ * Checked mode checks every index, except those proven in bounds before a
+ * loop and those of arrays that may have no size header.
+*/
+bool til::postfix_writer::needsIndexCheck(til::index_node * const node) {
+  return options::checked() && !_uncheckedIndexes.count(node) && allocatedPointer(node->pointer());
+}
+
+/*
+ * Checked mode: true if the value of an expression is null or comes from
+ * an objects allocation (and so has a size header).
+*/
+bool til::postfix_writer::allocatedPointer(cdk::expression_node * const node) {
+  if (dynamic_cast<til::alloc_node*>(node) || dynamic_cast<til::nullptr_node*>(node)) {
+    return true;
+  }
+  auto name = counted_loop::readVariable(node);
+  return name && !_headerlessPointers.count(*name);
+}
+
+/*
+ * Heap mode: the arena allocator, emitted once per module. It takes the
+ * size in bytes as its argument and returns 8-byte aligned memory from a
+ * bump pointer; objects are never freed, so there are no size classes.
+ * When the current chunk is full, brk extends the data segment by at least
+ * TIL_ARENA_CHUNK bytes (what is left of the old chunk is abandoned).
+*/
+void til::postfix_writer::generateArena(int lineno, int lvl) {
+  int growLbl = ++_lbl, bigLbl = ++_lbl, failLbl = ++_lbl, ptrLbl = ++_lbl, endLbl = ++_lbl;
+  auto ptr = "[" + mklbl(ptrLbl) + "]", end = "[" + mklbl(endLbl) + "]";
+  _arenaEmitted = true;
+
+  _pf.ALIGN();
+  _pf.LABEL(mklbl(_arenaLbl));
+  asmInstruction("mov eax, [esp+4]");
+  asmInstruction("add eax, 7");
+  asmInstruction("and eax, -8");
+  asmInstruction("mov ecx, " + ptr);
+  asmInstruction("lea edx, [ecx+eax]");
+  asmInstruction("cmp edx, " + end);
+  asmInstruction("jae " + mklbl(growLbl)); // also on the first call, when both are 0
+  asmInstruction("mov " + ptr + ", edx");
+  asmInstruction("mov eax, ecx");
+  asmInstruction("ret");
+
+  _pf.LABEL(mklbl(growLbl));
+  asmInstruction("push ebx");
+  asmInstruction("push eax");            // rounded size
+  asmInstruction("mov eax, 45");         // brk(0): the current break
+  asmInstruction("xor ebx, ebx");
+  asmInstruction("int 0x80");
+  asmInstruction("lea ecx, [eax+7]");
+  asmInstruction("and ecx, -8");         // the new chunk
+  asmInstruction("mov ebx, [esp]");
+  asmInstruction("cmp ebx, " + std::to_string(options::arenaChunk()));
+  asmInstruction("jae " + mklbl(bigLbl));
+  asmInstruction("mov ebx, " + std::to_string(options::arenaChunk()));
+  _pf.LABEL(mklbl(bigLbl));
+  asmInstruction("add ebx, ecx");
+  asmInstruction("push ecx");
+  asmInstruction("mov eax, 45");         // brk(chunk + size)
+  asmInstruction("int 0x80");
+  asmInstruction("pop ecx");
+  asmInstruction("cmp eax, ebx");
+  asmInstruction("jb " + mklbl(failLbl));
+  asmInstruction("mov " + end + ", eax");
+  asmInstruction("pop eax");
+  asmInstruction("pop ebx");
+  asmInstruction("lea edx, [ecx+eax]");
+  asmInstruction("mov " + ptr + ", edx");
+  asmInstruction("mov eax, ecx");
+  asmInstruction("ret");
+
+  _pf.LABEL(mklbl(failLbl));
+  (new cdk::string_node(lineno, "out of memory"))->accept(this, lvl);
+  _externalFunctionsToDeclare.insert("prints");
+  _pf.CALL("prints");
+  _externalFunctionsToDeclare.insert("println");
+  _pf.CALL("println");
+  asmInstruction("mov eax, 1"); // exit(1)
+  asmInstruction("mov ebx, 1");
+  asmInstruction("int 0x80");
+
+  _pf.BSS();
+  _pf.ALIGN();
+  _pf.LABEL(mklbl(ptrLbl));
+  _pf.SALLOC(4);
+  _pf.LABEL(mklbl(endLbl));
+  _pf.SALLOC(4);
+  _pf.TEXT(_functionLabels.top());
+}
+
+/*
+ * Jumps to failLabel unless the index at [esp+index] is within the array
+ * whose address is at [esp+pointer]. Only arrays with a header (objects
+ * allocations in checked mode) are checked; null pointers always fail.
+*/
+void til::postfix_writer::checkIndex(int pointer, int index, size_t elementSize, const std::string &failLabel) {
+  int okLbl = ++_lbl;
+  asmInstruction("mov eax, [esp+" + std::to_string(pointer) + "]");
+  asmInstruction("test eax, eax");
+  asmInstruction("jz " + failLabel);
+  asmInstruction("cmp dword [eax-4], " + std::to_string(checkedArrayTag));
+  asmInstruction("jne " + mklbl(okLbl));
+  asmInstruction("mov eax, [eax-8]"); // bytes in the array
+  elementSize = std::max(static_cast<size_t>(1), elementSize);
+  if ((elementSize & (elementSize - 1)) == 0) {
+    int shift = 0;
+    while ((static_cast<size_t>(1) << shift) < elementSize) shift++;
+    if (shift > 0) asmInstruction("shr eax, " + std::to_string(shift));
+  } else {
+    asmInstruction("xor edx, edx");
+    asmInstruction("mov ecx, " + std::to_string(elementSize));
+    asmInstruction("div ecx");
+  }
+  asmInstruction("cmp [esp+" + std::to_string(index) + "], eax");
+  asmInstruction("jae " + failLabel); // negative indices are huge when unsigned
+  _pf.LABEL(mklbl(okLbl));
+}
+
 void til::postfix_writer::do_nullptr_node(til::nullptr_node * const node, int lvl) {
   if (inFunction()) {
     _pf.INT(0);
@@ -530,10 +1208,63 @@ void til::postfix_writer::do_sizeof_node(til::sizeof_node * const node, int lvl)
 
 //---------------------------------------------------------------------------
 
+/*
+ * Finds a variable set to an integer literal right before the given
+ * instruction of a block (by the previous instruction or, for the first
+ * instruction, by the last declaration).
+*/
+static std::optional<std::pair<std::string, int>> constantBefore(til::block_node * const block, size_t index) {
+  cdk::lvalue_node *lvalue = nullptr;
+  cdk::expression_node *value = nullptr;
+
+  if (index > 0) {
+    auto evaluation = dynamic_cast<til::evaluation_node*>(block->instructions()->node(index - 1));
+    auto assignment = evaluation ? dynamic_cast<cdk::assignment_node*>(evaluation->argument()) : nullptr;
+    if (assignment != nullptr) {
+      lvalue = assignment->lvalue();
+      value = assignment->rvalue();
+    }
+  } else if (block->declarations()->size() > 0) {
+    auto declarations = block->declarations();
+    auto declaration = dynamic_cast<til::declaration_node*>(declarations->node(declarations->size() - 1));
+    if (declaration != nullptr && dynamic_cast<cdk::integer_node*>(declaration->initializer())) {
+      return std::make_pair(declaration->identifier(), dynamic_cast<cdk::integer_node*>(declaration->initializer())->value());
+    }
+  }
+
+  auto var = dynamic_cast<cdk::variable_node*>(lvalue);
+  auto literal = dynamic_cast<cdk::integer_node*>(value);
+  if (var == nullptr || literal == nullptr) {
+    return std::nullopt;
+  }
+  return std::make_pair(var->name(), literal->value());
+}
+
 void til::postfix_writer::do_block_node(til::block_node * const node, int lvl) {
   ASSERT_SAFE_EXPRESSIONS;
   
   _symtab.push();
+
+  // allocations that cannot outlive the block: constant ones get frame
+  // slots, the others are freed by restoring the stack pointer on exit
+  escape_analyser escapes(_compiler);
+  node->accept(&escapes, lvl);
+  bool dynamic = false;
+  for (auto alloc : escapes.ownAllocations()) {
+    if (auto bytes = escapes.fixedSize(alloc, options::allocSlotLimit())) {
+      _fixedAllocations[alloc] = *bytes;
+    } else {
+      dynamic = true;
+    }
+  }
+
+  bool restoresStack = inFunction() && dynamic && escapes.allLocal();
+  if (restoresStack) {
+    _offset -= 4;
+    asmInstruction("mov [ebp" + std::to_string(_offset) + "], esp");
+    _stackSaves.push_back(std::make_pair(_currentFunctionLoopLabels->size(), _offset));
+  }
+
   node->declarations()->accept(this, lvl + 2);
 
   _visitedFinalInstruction = false;
@@ -544,8 +1275,37 @@ void til::postfix_writer::do_block_node(til::block_node * const node, int lvl) {
       THROW_ERROR_FOR_NODE(child, "unreachable code");
     }
 
+    if (_elidedInstructions.count(child)) {
+      continue;
+    }
+
+    if (isInstanceOf<til::loop_node>(child)) {
+      _loopEntryValue = constantBefore(node, i);
+
+      // (loop ...) (set i start) (loop ...) over the same range run as one loop
+      while (i + 2 < node->instructions()->size()) {
+        auto fused = fuseLoops(dynamic_cast<til::loop_node*>(child), node->instructions()->node(i + 1),
+                               node->instructions()->node(i + 2), _loopEntryValue);
+        if (fused == nullptr) {
+          break;
+        }
+        child = fused;
+        i += 2;
+      }
+    }
+
     child->accept(this, lvl + 2);
   }
+
+  if (restoresStack) {
+    if (!_visitedFinalInstruction) {
+      asmInstruction("mov esp, [ebp" + std::to_string(_stackSaves.back().second) + "]");
+    }
+    _stackSaves.pop_back();
+  }
+  for (auto alloc : escapes.ownAllocations()) {
+    _fixedAllocations.erase(alloc);
+  }
   _visitedFinalInstruction = false;
 
   _symtab.pop();
@@ -562,7 +1322,7 @@ void til::postfix_writer::do_declaration_node(til::declaration_node * const node
   
   if (_inFunctionArgs) {
     offset = _offset;
-    _offset += type_size;
+    if (!_deadParameters.count(node)) _offset += type_size; // dead parameters are not passed
   } else if (inFunction()) {
     _offset -= type_size; // stack is backwards inside function
     offset = _offset;
@@ -571,6 +1331,18 @@ void til::postfix_writer::do_declaration_node(til::declaration_node * const node
   }
   symbol->offset(offset);
 
+  // a local chosen by promoteLocals lives in its register from here on
+  _promoted.erase(symbol.get());
+  if (inFunction() && !_inFunctionArgs && (node->is_typed(cdk::TYPE_INT) || node->is_typed(cdk::TYPE_POINTER))) {
+    if (auto reg = _promotable.find(symbol->name()); reg != _promotable.end()) _promoted[symbol.get()] = reg->second;
+  }
+
+  // an array variable that is only ever set here always holds this allocation
+  _allocationSites.erase(symbol.get());
+  if (inFunction() && !_inFunctionArgs && !_assigned.count(symbol->name()) && !_addressTaken.count(symbol->name())) {
+    if (auto alloc = dynamic_cast<til::alloc_node*>(node->initializer())) _allocationSites[symbol.get()] = alloc;
+  }
+
   if (inFunction()) { // handle function args
     if(_inFunctionArgs || node->initializer() == nullptr) {
       return;
@@ -578,7 +1350,9 @@ void til::postfix_writer::do_declaration_node(til::declaration_node * const node
 
     acceptCovariantNode(node->type(), node->initializer(), lvl);
 
-    if (node->is_typed(cdk::TYPE_DOUBLE)) {
+    if (auto reg = _promoted.find(symbol.get()); reg != _promoted.end()) {
+      asmInstruction("pop " + reg->second);
+    } else if (node->is_typed(cdk::TYPE_DOUBLE)) {
       _pf.LOCAL(symbol->offset());
       _pf.STDOUBLE();
     } else {
@@ -596,6 +1370,11 @@ void til::postfix_writer::do_declaration_node(til::declaration_node * const node
   
   _externalFunctionsToDeclare.erase(symbol->name());
 
+  std::optional<discarded_output> discarded;
+  if (_deadGlobals.count(symbol->name())) {
+    discarded.emplace(*this);
+  }
+
   if (node->initializer() == nullptr) { // uninitialized variable
     _pf.BSS();
     _pf.ALIGN();
@@ -609,7 +1388,13 @@ void til::postfix_writer::do_declaration_node(til::declaration_node * const node
     return;
   }
 
-  if (!isInstanceOf<cdk::integer_node, cdk::double_node, cdk::string_node, 
+  // numeric initializers are folded, and may use earlier globals' values
+  std::optional<constant_evaluator::constant> value;
+  if (node->is_typed(cdk::TYPE_INT) || node->is_typed(cdk::TYPE_DOUBLE)) {
+    value = constant_evaluator::evaluate(_compiler, _globalConstants, _pureFunctions, node->initializer());
+  }
+
+  if (!value && !isInstanceOf<cdk::integer_node, cdk::double_node, cdk::string_node, 
             til::nullptr_node, til::function_node>(node->initializer())) {
       THROW_ERROR("non-literal initializer for global variable '" + symbol->name() + "'");
   }
@@ -623,16 +1408,471 @@ void til::postfix_writer::do_declaration_node(til::declaration_node * const node
 
   _pf.LABEL(symbol->name());
 
-  if (node->is_typed(cdk::TYPE_DOUBLE) && node->initializer()->is_typed(cdk::TYPE_INT)) {
-    auto int_node = dynamic_cast<cdk::integer_node*>(node->initializer());
-    _pf.SDOUBLE(int_node->value());
-  } else {
-    node->initializer()->accept(this, lvl);
-  }
-}
+  // other modules may write public globals
+  bool immutable = symbol->qualifier() != tPUBLIC && !_moduleAssigned.count(symbol->name());
 
-void til::postfix_writer::do_function_node(til::function_node * const node, int lvl) {
-  ASSERT_SAFE_EXPRESSIONS;
+  if (value) {
+    if (node->is_typed(cdk::TYPE_DOUBLE)) {
+      value = constant_evaluator::toDouble(*value);
+      _pf.SDOUBLE(std::get<double>(*value));
+    } else {
+      _pf.SINT(std::get<int>(*value));
+    }
+    _globalConstants[symbol->name()] = *value;
+    if (immutable) _immutableGlobals[symbol->name()] = *value;
+    return;
+  }
+
+  auto function = dynamic_cast<til::function_node*>(node->initializer());
+  if (function != nullptr && immutable && options::memoize(symbol->name()) && memoizable(function)) {
+    _memoized.insert(function);
+  }
+
+  node->initializer()->accept(this, lvl);
+
+  // the body has been generated (and so type checked) by now
+  if (immutable && function != nullptr && pureFunction(function)) {
+    _pureFunctions[symbol->name()] = function;
+  }
+  if (immutable && function != nullptr) {
+    specializeFunction(symbol->name(), function, lvl);
+  }
+}
+
+/*
+ * A function can be memoized if its result only depends on its int
+ * arguments: it is pure, never changes its arguments, reads no memory
+ * through pointers and no global that may change, and only calls itself.
+ * The checks are syntactic, as the body has not been type checked yet.
+*/
+bool til::postfix_writer::memoizable(til::function_node * const node) {
+  auto output = cdk::functional_type::cast(node->type())->output(0);
+  if (!pureFunction(node) || (output->name() != cdk::TYPE_INT && output->name() != cdk::TYPE_DOUBLE)) {
+    return false;
+  }
+
+  effect_analyser effects(_compiler);
+  node->block()->accept(&effects, 0);
+  if (!effects.indexes().empty() || std::any_of(effects.calls().begin(), effects.calls().end(),
+                                                [](auto &call) { return call.first->func() != nullptr; })) {
+    return false;
+  }
+
+  std::set<std::string> parameters;
+  for (size_t i = 0; i < node->args()->size(); i++) {
+    auto parameter = dynamic_cast<til::declaration_node*>(node->args()->node(i));
+    if (!parameter->is_typed(cdk::TYPE_INT) || effects.assigned().count(parameter->identifier())) {
+      return false;
+    }
+    parameters.insert(parameter->identifier());
+  }
+
+  for (auto &read : effects.reads()) {
+    auto &name = read.first;
+    if (_immutableGlobals.count(name) || (parameters.count(name) && !effects.declared().count(name))) {
+      continue;
+    }
+    // a local, unless the name is also a global that may change
+    if (!effects.declared().count(name) || _symtab.find(name) != nullptr) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+ * Leaves in ecx the address of the memo table entry for the arguments at
+ * the given frame offsets (edx is also used). With one argument, it indexes
+ * the table directly, so small arguments never collide; more are hashed.
+ * Each entry holds a valid flag, the arguments and the result: a new result
+ * evicts whatever was in its entry.
+*/
+void til::postfix_writer::memoEntry(const std::vector<int> &key, size_t entrySize, int table) {
+  int bits = 0;
+  while ((2 << bits) <= options::memoEntries() && bits < 24) bits++;
+
+  if (key.empty() || options::memoEntries() < 2) {
+    asmInstruction("xor ecx, ecx");
+  } else if (key.size() == 1) {
+    asmInstruction("mov ecx, [ebp+" + std::to_string(key[0]) + "]");
+    asmInstruction("and ecx, " + std::to_string((1 << bits) - 1));
+  } else {
+    asmInstruction("mov ecx, [ebp+" + std::to_string(key[0]) + "]");
+    for (size_t k = 1; k < key.size(); k++) {
+      asmInstruction("imul ecx, ecx, 31");
+      asmInstruction("add ecx, [ebp+" + std::to_string(key[k]) + "]");
+    }
+    asmInstruction("imul ecx, ecx, 0x9E3779B1"); // Fibonacci hashing: the top bits are the index
+    asmInstruction("shr ecx, " + std::to_string(32 - bits));
+  }
+  asmInstruction("imul ecx, ecx, " + std::to_string(entrySize));
+  asmInstruction("add ecx, " + mklbl(table));
+}
+
+std::vector<std::optional<til::constant_evaluator::constant>> til::postfix_writer::literalArguments(
+            til::function_call_node * const node) {
+  std::vector<std::optional<constant_evaluator::constant>> arguments;
+  for (size_t i = 0; i < node->args()->size(); i++) {
+    if (auto integer = dynamic_cast<cdk::integer_node*>(node->args()->node(i))) {
+      arguments.push_back(integer->value());
+    } else if (auto real = dynamic_cast<cdk::double_node*>(node->args()->node(i))) {
+      arguments.push_back(real->value());
+    } else {
+      arguments.push_back(std::nullopt);
+    }
+  }
+  return arguments;
+}
+
+/*
+ * Finds the private globals that nothing reachable refers to. The program
+ * and the public declarations are reached; so is every global named
+ * (read, written or used with ?) by the initializer of a reached one,
+ * function bodies included, so that a function stored into a global
+ * keeps it. Generated units carry large libraries of helpers, of which
+ * a program uses a few.
+*/
+void til::postfix_writer::findDeadGlobals(cdk::sequence_node * const module) {
+  std::map<std::string, std::set<std::string>> references; // names used by the declarations of each global
+  std::vector<std::string> pending; // reached, and still to follow
+  std::vector<std::string> privates;
+
+  for (size_t i = 0; i < module->size(); i++) {
+    effect_analyser effects(_compiler, true);
+    module->node(i)->accept(&effects, 0);
+    std::set<std::string> names(effects.assigned().begin(), effects.assigned().end());
+    names.insert(effects.addressTaken().begin(), effects.addressTaken().end());
+    for (auto &read : effects.reads()) names.insert(read.first);
+
+    auto declaration = dynamic_cast<til::declaration_node*>(module->node(i));
+    if (declaration == nullptr) { // the program
+      pending.insert(pending.end(), names.begin(), names.end());
+      continue;
+    }
+    references[declaration->identifier()].insert(names.begin(), names.end());
+    if (declaration->qualifier() == tPRIVATE) {
+      privates.push_back(declaration->identifier());
+    } else {
+      pending.push_back(declaration->identifier());
+    }
+  }
+
+  std::set<std::string> reached;
+  while (!pending.empty()) {
+    auto name = pending.back();
+    pending.pop_back();
+    if (reached.insert(name).second) {
+      auto &names = references[name];
+      pending.insert(pending.end(), names.begin(), names.end());
+    }
+  }
+
+  for (auto &name : privates) {
+    if (!reached.count(name)) _deadGlobals.insert(name);
+  }
+}
+
+/*
+ * Finds the private global functions that are only ever called directly
+ * (never used as values), so that their calls can skip what the callee
+ * never uses: parameters every call passes as the same literal become
+ * constants, and these and the parameters the body never reads are not
+ * passed at all. When no call uses the result, it is not returned either.
+ * The functions keep their types: only the calling sequence changes.
+*/
+void til::postfix_writer::analyseConventions(cdk::sequence_node * const module, effect_analyser &effects) {
+  std::map<std::string, int> declarations;
+  for (size_t i = 0; i < module->size(); i++) {
+    if (auto declaration = dynamic_cast<til::declaration_node*>(module->node(i))) {
+      declarations[declaration->identifier()]++;
+    }
+  }
+
+  std::map<std::string, std::vector<til::function_call_node*>> calls;
+  for (auto &call : effects.calls()) {
+    auto callee = dynamic_cast<cdk::rvalue_node*>(call.first->func());
+    if (auto name = callee ? dynamic_cast<cdk::variable_node*>(callee->lvalue()) : nullptr) {
+      calls[name->name()].push_back(call.first);
+    }
+  }
+
+  for (size_t i = 0; i < module->size(); i++) {
+    auto declaration = dynamic_cast<til::declaration_node*>(module->node(i));
+    auto function = declaration ? dynamic_cast<til::function_node*>(declaration->initializer()) : nullptr;
+    if (function == nullptr || function->is_main() || declaration->qualifier() != tPRIVATE
+        || _deadGlobals.count(declaration->identifier())) {
+      continue;
+    }
+    auto &name = declaration->identifier();
+    if (declarations[name] != 1 || _moduleAssigned.count(name) || effects.reads(name) != calls[name].size()) {
+      continue; // forward declared, reassigned or used as a value
+    }
+
+    effect_analyser body(_compiler);
+    function->block()->accept(&body, 0);
+    auto callers = calls[name];
+    for (auto &call : body.calls()) {
+      if (call.first->func() == nullptr) callers.push_back(call.first); // @
+    }
+    if (callers.empty() || std::any_of(callers.begin(), callers.end(),
+                  [function](auto call) { return call->args()->size() != function->args()->size(); })) {
+      continue; // the type checker will complain about the latter
+    }
+
+    convention sequence;
+    bool changed = false;
+    for (size_t p = 0; p < function->args()->size(); p++) {
+      auto parameter = dynamic_cast<til::declaration_node*>(function->args()->node(p));
+      auto &id = parameter->identifier();
+      bool untouched = !body.assigned().count(id) && !body.declared().count(id) && !body.addressTaken().count(id);
+
+      std::optional<constant_evaluator::constant> literal = literalArguments(callers.front())[p];
+      for (auto caller : callers) {
+        if (literal != literalArguments(caller)[p]) literal.reset();
+      }
+      if (untouched && literal) {
+        if (auto value = constant_evaluator::convert(*literal, parameter->type())) sequence.constants[id] = *value;
+      }
+
+      sequence.dead.push_back(untouched && (sequence.constants.count(id) || body.reads(id) == 0));
+      if (sequence.dead.back()) {
+        _deadParameters.insert(parameter);
+        changed = true;
+      }
+    }
+
+    auto output = cdk::functional_type::cast(function->type())->output(0);
+    sequence.resultUnused = output->name() != cdk::TYPE_VOID && std::all_of(callers.begin(), callers.end(),
+                  [&effects, &body](auto call) { return effects.discardedCalls().count(call) || body.discardedCalls().count(call); });
+
+    if (changed || sequence.resultUnused) {
+      _privateFunctions[name] = function;
+      _conventions[function] = sequence;
+    }
+  }
+}
+
+/*
+ * Checked mode: finds the variables that may point to memory without a
+ * size header, whose indices cannot be checked. Only objects allocations
+ * have one. Any other value (arithmetic, ?, loads, calls) spreads to the
+ * variables it is assigned to and to the parameters it is passed to.
+ * Globals other modules see, variables used with ? and the parameters of
+ * functions not only called by name may hold anything.
+*/
+void til::postfix_writer::findHeaderlessPointers(cdk::sequence_node * const module, effect_analyser &effects) {
+  std::map<std::string, std::vector<til::function_call_node*>> calls;
+  for (auto &call : effects.calls()) {
+    auto callee = dynamic_cast<cdk::rvalue_node*>(call.first->func());
+    if (auto name = callee ? dynamic_cast<cdk::variable_node*>(callee->lvalue()) : nullptr) {
+      calls[name->name()].push_back(call.first);
+    }
+  }
+
+  // the arguments of the parameters of private functions only called by name
+  std::map<til::declaration_node*, std::vector<cdk::expression_node*>> arguments;
+  for (size_t i = 0; i < module->size(); i++) {
+    auto declaration = dynamic_cast<til::declaration_node*>(module->node(i));
+    if (declaration == nullptr || _deadGlobals.count(declaration->identifier())) {
+      continue;
+    }
+    auto &name = declaration->identifier();
+    auto function = dynamic_cast<til::function_node*>(declaration->initializer());
+    if (declaration->qualifier() != tPRIVATE) {
+      _headerlessPointers.insert(name);
+      continue;
+    }
+    if (function == nullptr || effects.declarations().at(name).size() != 1 || _moduleAssigned.count(name)
+        || effects.reads(name) != calls[name].size()) {
+      continue;
+    }
+
+    effect_analyser body(_compiler);
+    function->block()->accept(&body, 0);
+    auto callers = calls[name];
+    for (auto &call : body.calls()) {
+      if (call.first->func() == nullptr) callers.push_back(call.first); // @
+    }
+    if (std::any_of(callers.begin(), callers.end(),
+                    [function](auto call) { return call->args()->size() != function->args()->size(); })) {
+      continue;
+    }
+    for (size_t p = 0; p < function->args()->size(); p++) {
+      auto &passed = arguments[dynamic_cast<til::declaration_node*>(function->args()->node(p))];
+      for (auto caller : callers) passed.push_back(dynamic_cast<cdk::expression_node*>(caller->args()->node(p)));
+    }
+  }
+
+  for (auto parameter : effects.parameters()) {
+    if (!arguments.count(parameter)) _headerlessPointers.insert(parameter->identifier());
+  }
+  _headerlessPointers.insert(_moduleAddressTaken.begin(), _moduleAddressTaken.end());
+
+  for (bool changed = true; changed;) {
+    changed = false;
+    auto spread = [&](const std::string &name, cdk::expression_node *value) {
+      if (!allocatedPointer(value) && _headerlessPointers.insert(name).second) changed = true;
+    };
+    for (auto &declarations : effects.declarations()) {
+      for (auto declaration : declarations.second) {
+        if (declaration->initializer() != nullptr) spread(declaration->identifier(), declaration->initializer());
+      }
+    }
+    for (auto assignment : effects.assignments()) {
+      if (auto variable = dynamic_cast<cdk::variable_node*>(assignment->lvalue())) spread(variable->name(), assignment->rvalue());
+    }
+    for (auto &parameter : arguments) {
+      for (auto argument : parameter.second) spread(parameter.first->identifier(), argument);
+    }
+  }
+}
+
+/*
+ * Generates copies of a global function (just generated) for the literal
+ * arguments it is called with most, hottest first, until the clones would
+ * exceed TIL_SPECIALIZE_BUDGET nodes. Calls from a loop weigh 10 and a
+ * pattern needs a weight of 2. A parameter is only fixed if the body never
+ * writes it, redeclares its name or takes its address. Clones keep the
+ * calling sequence, so @ in a clone calls the original.
+*/
+void til::postfix_writer::specializeFunction(const std::string &name, til::function_node * const node, int lvl) {
+  static constexpr size_t maxClones = 4;
+  auto patterns = _callPatterns.find(name);
+  if (patterns == _callPatterns.end()) {
+    return;
+  }
+  auto original = _lastFunctionLabel;
+
+  effect_analyser effects(_compiler);
+  node->block()->accept(&effects, lvl);
+  if (effects.hasFunctions()) {
+    return;
+  }
+
+  std::vector<std::pair<int, const std::vector<std::optional<constant_evaluator::constant>>*>> ranked;
+  for (auto &pattern : patterns->second) {
+    ranked.push_back(std::make_pair(pattern.second, &pattern.first));
+  }
+  std::stable_sort(ranked.begin(), ranked.end(), [](auto &a, auto &b) { return a.first > b.first; });
+
+  for (auto &[weight, arguments] : ranked) {
+    if (weight < 2 || _clones[name].size() >= maxClones || static_cast<int>(effects.nodes()) > _specializationBudget) {
+      break;
+    } else if (arguments->size() != node->args()->size()) {
+      continue;
+    }
+
+    std::map<size_t, constant_evaluator::constant> fixed; // the literals, as written in the calls
+    std::map<std::string, constant_evaluator::constant> parameters; // ... converted to the parameters' types
+    for (size_t i = 0; i < arguments->size(); i++) {
+      auto parameter = dynamic_cast<til::declaration_node*>(node->args()->node(i));
+      auto &id = parameter->identifier();
+      if (!(*arguments)[i] || effects.assigned().count(id) || effects.declared().count(id) || effects.addressTaken().count(id)) {
+        continue;
+      }
+      if (auto value = constant_evaluator::convert(*(*arguments)[i], parameter->type())) {
+        fixed[i] = *(*arguments)[i];
+        parameters[id] = *value;
+      }
+    }
+
+    auto &clones = _clones[name];
+    if (fixed.empty() || std::any_of(clones.begin(), clones.end(), [&fixed](auto &c) { return c.first == fixed; })) {
+      continue;
+    }
+
+    _specializationBudget -= effects.nodes();
+    _cloneArguments = parameters;
+    _cloneOf = original;
+    node->accept(this, lvl);
+    clones.push_back(std::make_pair(fixed, _lastFunctionLabel));
+  }
+}
+
+/*
+ * A function may run at compile time if it only writes its own locals and
+ * has no I/O, allocations, pointers to locals or nested functions. Calls
+ * and everything else are checked as the function is interpreted.
+*/
+bool til::postfix_writer::pureFunction(til::function_node * const node) {
+  effect_analyser effects(_compiler);
+  node->block()->accept(&effects, 0);
+  if (effects.hasIO() || effects.hasAllocs() || effects.hasIndexStores() || effects.hasFunctions()
+      || !effects.addressTaken().empty()) {
+    return false;
+  }
+
+  auto locals = effects.declared();
+  for (size_t i = 0; i < node->args()->size(); i++) {
+    locals.insert(dynamic_cast<til::declaration_node*>(node->args()->node(i))->identifier());
+  }
+  return std::all_of(effects.assigned().begin(), effects.assigned().end(),
+                     [&locals](auto &name) { return locals.count(name) > 0; });
+}
+
+/*
+ * Register promotion: the int and pointer locals used most (a use in a loop
+ * weighs as 8 outside it) live in ebx, esi and edi for the whole function
+ * instead of in their frame slots. Only names declared once in the body and
+ * never used with ? qualify, so each register holds a single variable that
+ * nothing can reach through memory. The postfix machine only uses eax, ecx
+ * and edx between operations and code borrowing the others saves them, so
+ * the registers survive everything but the function's return, which
+ * restores the caller's values. Memory is only written when another thread
+ * needs the value (see spillPromoted).
+*/
+void til::postfix_writer::promoteLocals(effect_analyser &effects) {
+  _promotable.clear();
+
+  std::vector<std::pair<size_t, std::string>> candidates;
+  for (auto &use : effects.weightedUses()) {
+    auto declarations = effects.declarations().find(use.first);
+    if (declarations == effects.declarations().end() || declarations->second.size() != 1
+        || effects.addressTaken().count(use.first) || use.second < 2) {
+      continue;
+    }
+    // declarations with var are typed later: the register is not used if they are not int or pointer
+    auto type = declarations->second.front()->type();
+    if (type == nullptr || type->name() == cdk::TYPE_INT || type->name() == cdk::TYPE_POINTER
+        || type->name() == cdk::TYPE_UNSPEC) {
+      candidates.push_back(std::make_pair(use.second, use.first));
+    }
+  }
+  std::stable_sort(candidates.begin(), candidates.end(), [](auto &a, auto &b) { return a.first > b.first; });
+
+  size_t registers = std::min<size_t>(std::max(0, options::promoteLocals()), std::size(promotionRegisters));
+  for (size_t k = 0; k < candidates.size() && k < registers; k++) {
+    _promotable[candidates[k].second] = promotionRegisters[k];
+  }
+}
+
+std::optional<std::string> til::postfix_writer::promotedRegister(const std::string &name) {
+  auto symbol = _symtab.find(name);
+  auto promoted = symbol == nullptr ? _promoted.end() : _promoted.find(symbol.get());
+  if (promoted == _promoted.end()) {
+    return std::nullopt;
+  }
+  return promoted->second;
+}
+
+/*
+ * Writes the promoted locals in scope to their frame slots (or, with
+ * reload, reads them back from the slots of a copy of the frame).
+*/
+void til::postfix_writer::spillPromoted(bool reload) {
+  for (auto &promotable : _promotable) {
+    // out of scope, a local's slot may belong to another variable
+    auto symbol = _symtab.find(promotable.first);
+    if (symbol == nullptr || !_promoted.count(symbol.get())) {
+      continue;
+    }
+    auto slot = "[ebp" + std::to_string(symbol->offset()) + "]";
+    asmInstruction(reload ? "mov " + promotable.second + ", " + slot : "mov " + slot + ", " + promotable.second);
+  }
+}
+
+void til::postfix_writer::do_function_node(til::function_node * const node, int lvl) {
+  ASSERT_SAFE_EXPRESSIONS;
   
   std::string functionLabel;
 
@@ -645,6 +1885,23 @@ void til::postfix_writer::do_function_node(til::function_node * const node, int
   // keep track of the current function
   _functionLabels.push(functionLabel);
 
+  // a clone (see specializeFunction) reads its fixed parameters as literals
+  bool clone = !_cloneOf.empty();
+  auto oldSpecializedArguments = _specializedArguments;
+  auto oldRecursionLabel = _recursionLabel;
+  _specializedArguments = _cloneArguments;
+  _recursionLabel = clone ? _cloneOf : functionLabel;
+
+  // private functions may be called with fewer arguments
+  auto oldConvention = _currentConvention;
+  auto convention = _conventions.find(node);
+  _currentConvention = convention == _conventions.end() ? nullptr : &convention->second;
+  if (_currentConvention != nullptr) {
+    _specializedArguments.insert(_currentConvention->constants.begin(), _currentConvention->constants.end());
+  }
+  _cloneArguments.clear();
+  _cloneOf.clear();
+
   _pf.TEXT(_functionLabels.top());
   _pf.ALIGN();
 
@@ -667,9 +1924,76 @@ void til::postfix_writer::do_function_node(til::function_node * const node, int
   node->block()->accept(&fsc, lvl);
   _pf.ENTER(fsc.localsize());
 
+  auto oldFrameSize = _frameSize, oldArgumentsSize = _argumentsSize;
+  _frameSize = fsc.localsize();
+  _argumentsSize = _offset - 8;
+
+  // locals whose address is taken may change behind the code generator's back
+  auto oldAddressTaken = _addressTaken;
+  auto oldAssigned = _assigned;
+  effect_analyser analyser(_compiler);
+  node->block()->accept(&analyser, lvl);
+  _addressTaken = analyser.addressTaken();
+  _assigned = analyser.assigned();
+
+  // the registers of promoted locals are saved right below the locals
+  auto oldPromotable = _promotable;
+  auto oldPromoted = _promoted;
+  promoteLocals(analyser);
+  for (size_t k = 0; k < _promotable.size(); k++) {
+    asmInstruction(std::string("push ") + promotionRegisters[k]);
+  }
+
   auto oldFunctionRetLabel = _currentFunctionRetLabel;
   _currentFunctionRetLabel = mklbl(++_lbl);
 
+  // memoized: a result in the table for the same arguments is returned at once
+  bool memoized = _memoized.count(node) > 0;
+  bool doubleResult = cdk::functional_type::cast(node->type())->output(0)->name() == cdk::TYPE_DOUBLE;
+  std::vector<int> memoKey;
+  size_t entrySize = 0;
+  int memoTable = 0, memoReturnLbl = 0;
+  if (memoized) {
+    for (size_t i = 0; i < node->args()->size(); i++) {
+      auto parameter = dynamic_cast<til::declaration_node*>(node->args()->node(i));
+      if (!_deadParameters.count(parameter)) memoKey.push_back(_symtab.find(parameter->identifier())->offset());
+    }
+    entrySize = 4 * (1 + memoKey.size()) + (doubleResult ? 8 : 4);
+    memoTable = ++_lbl;
+    memoReturnLbl = ++_lbl;
+    int missLbl = ++_lbl;
+
+    memoEntry(memoKey, entrySize, memoTable);
+    asmInstruction("cmp dword [ecx], 0");
+    asmInstruction("je " + mklbl(missLbl));
+    for (size_t k = 0; k < memoKey.size(); k++) {
+      asmInstruction("mov edx, [ebp+" + std::to_string(memoKey[k]) + "]");
+      asmInstruction("cmp edx, [ecx+" + std::to_string(4 * (k + 1)) + "]");
+      asmInstruction("jne " + mklbl(missLbl));
+    }
+    auto result = "[ecx+" + std::to_string(4 * (1 + memoKey.size())) + "]";
+    asmInstruction(doubleResult ? "fld qword " + result : "mov eax, " + result);
+    asmInstruction("jmp " + mklbl(memoReturnLbl));
+    _pf.LABEL(mklbl(missLbl));
+  }
+
+  auto oldIndexFailLbl = _indexFailLbl;
+  _indexFailLbl = 0;
+
+  auto oldStackSaves = _stackSaves;
+  _stackSaves.clear();
+
+  // heap mode: allocations the function cannot prove local go to the arena
+  auto oldHeapAllocations = _heapAllocations;
+  _heapAllocations.clear();
+  if (options::heapAllocation()) {
+    escape_analyser escapes(_compiler);
+    node->block()->accept(&escapes, lvl);
+    for (auto alloc : escapes.allocations()) {
+      if (!escapes.local(alloc)) _heapAllocations.insert(alloc);
+    }
+  }
+
   auto oldFunctionLoopLabels = _currentFunctionLoopLabels;
   _currentFunctionLoopLabels = new std::vector<std::pair<std::string, std::string>>();
 
@@ -682,13 +2006,69 @@ void til::postfix_writer::do_function_node(til::function_node * const node, int
     _pf.STFVAL32(); // returns 0 if main
   }
 
-  _pf.ALIGN();
   _pf.LABEL(_currentFunctionRetLabel);
+  if (memoized) {
+    // the result (in eax or st0) goes into the table
+    memoEntry(memoKey, entrySize, memoTable);
+    asmInstruction("mov dword [ecx], 1");
+    for (size_t k = 0; k < memoKey.size(); k++) {
+      asmInstruction("mov edx, [ebp+" + std::to_string(memoKey[k]) + "]");
+      asmInstruction("mov [ecx+" + std::to_string(4 * (k + 1)) + "], edx");
+    }
+    auto result = "[ecx+" + std::to_string(4 * (1 + memoKey.size())) + "]";
+    asmInstruction(doubleResult ? "fst qword " + result : "mov " + result + ", eax");
+    _pf.LABEL(mklbl(memoReturnLbl));
+  }
+  for (size_t k = 0; k < _promotable.size(); k++) {
+    asmInstruction(std::string("mov ") + promotionRegisters[k] + ", [ebp-" + std::to_string(_frameSize + 4 * (k + 1)) + "]");
+  }
   _pf.LEAVE();
   _pf.RET();
 
+  if (_indexFailLbl != 0) {
+    // out-of-bounds accesses in this function end the program here
+    _pf.LABEL(mklbl(_indexFailLbl));
+    (new cdk::string_node(node->lineno(), "index out of bounds"))->accept(this, lvl);
+    _externalFunctionsToDeclare.insert("prints");
+    _pf.CALL("prints");
+    _externalFunctionsToDeclare.insert("println");
+    _pf.CALL("println");
+    asmInstruction("mov eax, 1"); // exit(1)
+    asmInstruction("mov ebx, 1");
+    asmInstruction("int 0x80");
+  }
+  _indexFailLbl = oldIndexFailLbl;
+
+  if (memoized) {
+    int entries = 1;
+    while (entries * 2 <= options::memoEntries() && entries < (1 << 24)) entries *= 2;
+    _pf.BSS();
+    _pf.ALIGN();
+    _pf.LABEL(mklbl(memoTable));
+    _pf.SALLOC(entries * entrySize);
+    _pf.TEXT(_functionLabels.top());
+  }
+  _stackSaves = oldStackSaves;
+  _heapAllocations = oldHeapAllocations;
+  _specializedArguments = oldSpecializedArguments;
+  _recursionLabel = oldRecursionLabel;
+  _currentConvention = oldConvention;
+  _frameSize = oldFrameSize;
+  _argumentsSize = oldArgumentsSize;
+
+  if (_arenaLbl != 0 && !_arenaEmitted) {
+    generateArena(node->lineno(), lvl);
+  }
+  if (_poolLbl != 0 && !_poolEmitted) {
+    generateThreadPool();
+  }
+
   delete _currentFunctionLoopLabels;
   _currentFunctionLoopLabels = oldFunctionLoopLabels; // restore loop labels
+  _addressTaken = oldAddressTaken;
+  _assigned = oldAssigned;
+  _promotable = oldPromotable;
+  _promoted = oldPromoted;
   _currentFunctionRetLabel = oldFunctionRetLabel; // restore return label
   _offset = oldOffset; // restore offset
   _symtab.pop();
@@ -702,6 +2082,11 @@ void til::postfix_writer::do_function_node(til::function_node * const node, int
     return;
   }
 
+  _lastFunctionLabel = functionLabel;
+  if (clone) {
+    return; // only called directly
+  }
+
   if (inFunction()) {
     _pf.TEXT(_functionLabels.top());
     _pf.ADDR(functionLabel);
@@ -712,6 +2097,8 @@ void til::postfix_writer::do_function_node(til::function_node * const node, int
 }
 
 void til::postfix_writer::do_function_call_node(til::function_call_node * const node, int lvl) {
+  bool valueDiscarded = _valueDiscarded;
+  _valueDiscarded = false;
   ASSERT_SAFE_EXPRESSIONS;
   
   std::shared_ptr<cdk::functional_type> functype;
@@ -723,35 +2110,96 @@ void til::postfix_writer::do_function_call_node(til::function_call_node * const
     functype = cdk::functional_type::cast(node->func()->type());
   }
 
+  // pure functions called with constant arguments run at compile time
+  auto callee = dynamic_cast<cdk::rvalue_node*>(node->func());
+  auto name = callee ? dynamic_cast<cdk::variable_node*>(callee->lvalue()) : nullptr;
+  if (name != nullptr && _pureFunctions.count(name->name()) && _symtab.find(name->name())->global()) {
+    // the arguments are evaluated here, where a local or parameter hides the global of its name
+    const auto *globals = &_immutableGlobals;
+    std::map<std::string, constant_evaluator::constant> visible;
+    effect_analyser arguments(_compiler);
+    node->args()->accept(&arguments, lvl);
+    for (auto &read : arguments.reads()) {
+      auto symbol = _symtab.find(read.first);
+      if (symbol != nullptr && !symbol->global() && globals->count(read.first)) {
+        if (globals != &visible) visible = *globals;
+        globals = &visible;
+        visible.erase(read.first);
+      }
+    }
+    if (auto value = constant_evaluator::evaluate(_compiler, *globals, _pureFunctions, node)) {
+      if (valueDiscarded || node->is_typed(cdk::TYPE_VOID)) {
+        // EMPTY: the call has no effect
+      } else if (node->is_typed(cdk::TYPE_DOUBLE)) {
+        _pf.DOUBLE(constant_evaluator::toDouble(*value));
+      } else {
+        _pf.INT(std::get<int>(*value));
+      }
+      return;
+    }
+  }
+
+  // calls with the literal arguments of a clone of the function call the clone
+  std::optional<std::string> clone;
+  if (name != nullptr && _clones.count(name->name()) && _symtab.find(name->name())->global()) {
+    auto arguments = literalArguments(node);
+    for (auto &candidate : _clones.at(name->name())) {
+      if (std::all_of(candidate.first.begin(), candidate.first.end(),
+                      [&arguments](auto &fixed) { return arguments[fixed.first] == fixed.second; })) {
+        clone = candidate.second;
+        break;
+      }
+    }
+  }
+
+  // private functions may take fewer arguments
+  const convention *sequence = nullptr;
+  if (node->func() == nullptr) {
+    sequence = _currentConvention;
+  } else if (name != nullptr && _privateFunctions.count(name->name()) && _symtab.find(name->name())->global()) {
+    sequence = &_conventions.at(_privateFunctions.at(name->name()));
+  }
+
   int args_size = 0;
 
   // visit in reverse since function stack is backwards
   for (size_t i = node->args()->size(); i > 0; i--) {
     auto arg = dynamic_cast<cdk::expression_node*>(node->args()->node(i - 1));
 
+    if (sequence != nullptr && sequence->dead[i - 1]) {
+      acceptDiscarded(arg, lvl + 2); // not passed: only its side effects remain
+      continue;
+    }
+
     args_size += arg->type()->size();
     acceptCovariantNode(functype->input(i - 1), arg, lvl + 2);
   }
 
   _externalFunctionName = std::nullopt;
-  if (node->func() == nullptr) { // recursive call
-    _pf.ADDR(_functionLabels.top());
+  if (clone) {
+    _pf.CALL(*clone);
   } else {
-    node->func()->accept(this, lvl);
-  }
+    if (node->func() == nullptr) { // recursive call
+      _pf.ADDR(_recursionLabel);
+    } else {
+      node->func()->accept(this, lvl);
+    }
 
-  if(_externalFunctionName) {
-    _pf.CALL(*_externalFunctionName);
-    _externalFunctionName = std::nullopt;
-  } else {
-    _pf.BRANCH();
+    if(_externalFunctionName) {
+      _pf.CALL(*_externalFunctionName);
+      _externalFunctionName = std::nullopt;
+    } else {
+      _pf.BRANCH();
+    }
   }
 
   if (args_size > 0) {
     _pf.TRASH(args_size);
   }
 
-  if (node->is_typed(cdk::TYPE_DOUBLE)) {
+  if (valueDiscarded) {
+    // statement-level call: the return value stays in the register
+  } else if (node->is_typed(cdk::TYPE_DOUBLE)) {
     _pf.LDFVAL64();
   } else if (!node->is_typed(cdk::TYPE_VOID)) {
     _pf.LDFVAL32();
@@ -764,7 +2212,9 @@ void til::postfix_writer::do_return_node(til::return_node * const node, int lvl)
   auto symbol = _symtab.find("@", 1); // every function has an @ symbol
   auto rettype = cdk::functional_type::cast(symbol->type())->output(0);
 
-  if (rettype->name() != cdk::TYPE_VOID) {
+  if (rettype->name() != cdk::TYPE_VOID && _currentConvention != nullptr && _currentConvention->resultUnused) {
+    acceptDiscarded(node->retValue(), lvl + 2); // no call uses the result
+  } else if (rettype->name() != cdk::TYPE_VOID) {
     acceptCovariantNode(rettype, node->retValue(), lvl + 2);
 
     if (rettype->name() == cdk::TYPE_DOUBLE) {
@@ -796,6 +2246,14 @@ void til::postfix_writer::executeControlLoopInstruction(T * const node) {
   // Gets condition label (0) or end label (1) for loop
   auto index = _currentFunctionLoopLabels->size() - lvl;
   auto label = std::get<P>(_currentFunctionLoopLabels->at(index));
+
+  // frees what the blocks being left allocated (the outermost one suffices)
+  for (auto &save : _stackSaves) {
+    if (save.first > index) {
+      asmInstruction("mov esp, [ebp" + std::to_string(save.second) + "]");
+      break;
+    }
+  }
   _pf.JMP(label);
 
   _visitedFinalInstruction = true;
@@ -803,23 +2261,1635 @@ void til::postfix_writer::executeControlLoopInstruction(T * const node) {
 
 void til::postfix_writer::do_loop_node(til::loop_node * const node, int lvl) {
   ASSERT_SAFE_EXPRESSIONS;
-  int condLbl, endLbl;
 
-  _pf.ALIGN();
-  _pf.LABEL(mklbl(condLbl = ++_lbl));
-  node->condition()->accept(this, lvl);
-  _pf.JZ(mklbl(endLbl = ++_lbl));
+  auto entryValue = _loopEntryValue;
+  _loopEntryValue.reset();
 
-  // loop body
-  _currentFunctionLoopLabels->push_back(std::make_pair(mklbl(condLbl), mklbl(endLbl)));
-  node->block()->accept(this, lvl + 2);
-  _visitedFinalInstruction = false;
-  _currentFunctionLoopLabels->pop_back();
-  
-  // jump to condition
-  _pf.JMP(mklbl(condLbl));
-  _pf.ALIGN();
-  _pf.LABEL(mklbl(endLbl));
+  // pointer increments belong to the innermost counted loop only
+  auto pointerIncrements = _pointerIncrements;
+  _pointerIncrements.clear();
+
+  auto offset = _offset;
+  std::vector<cdk::rvalue_node*> hoisted;
+  std::vector<til::index_node*> forwarded;
+  auto skipLbl = hoistLoads(node, hoisted, forwarded, lvl);
+
+  if (!parallelizeLoop(node, entryValue, lvl) && (!options::checked() || !versionLoop(node, entryValue, lvl))) {
+    optimiseLoop(node, entryValue, lvl);
+  }
+
+  // forwarded elements go back to memory (once each)
+  std::set<int> written;
+  for (auto index : forwarded) {
+    auto slot = _forwardedElements.at(index);
+    if (written.insert(slot).second) {
+      _pf.LOCAL(slot);
+      if (index->is_typed(cdk::TYPE_DOUBLE)) _pf.LDDOUBLE(); else _pf.LDINT();
+      index->accept(this, lvl);
+      if (index->is_typed(cdk::TYPE_DOUBLE)) _pf.STDOUBLE(); else _pf.STINT();
+    }
+  }
+  for (auto index : forwarded) {
+    _forwardedElements.erase(index);
+  }
+
+  if (skipLbl) {
+    _pf.LABEL(mklbl(*skipLbl));
+  }
+  for (auto rvalue : hoisted) {
+    _hoistedLoads.erase(rvalue);
+  }
+  _offset = offset;
+  _pointerIncrements = pointerIncrements;
+}
+
+/*
+ * Loads that every iteration repeats with the same result are done once,
+ * before the loop, into frame slots (at most TIL_HOIST_LOADS per loop):
+ * array elements (index a k) and globals whose variables the loop does not
+ * write, and that no store in the loop may alias (see alias_analysis).
+ * Calls may store anywhere, so loops with calls keep their loads. The
+ * condition is tested first (and again by the loop), so a loop that does
+ * not run loads nothing. Returns the label after the loop, if it is needed.
+ *
+ * An element the loop also stores is forwarded: when those stores are the
+ * only ones that may reach it and every other access of the loop, element
+ * or variable, is known to be elsewhere, its loads and stores use the slot,
+ * which is written back once the loop ends (see do_loop_node). Returns and
+ * exits from outer loops would skip that, so they rule it out.
+*/
+std::optional<int> til::postfix_writer::hoistLoads(til::loop_node * const node, std::vector<cdk::rvalue_node*> &hoisted,
+            std::vector<til::index_node*> &forwarded, int lvl) {
+  if (options::hoistLoads() <= 0 || options::checked()) {
+    return std::nullopt;
+  }
+
+  effect_analyser effects(_compiler), condition(_compiler);
+  node->accept(&effects, lvl);
+  node->condition()->accept(&condition, lvl);
+  if (effects.hasCalls() || !condition.pure()) {
+    return std::nullopt;
+  }
+
+  alias_analysis aliases(_symtab, _addressTaken, _moduleAddressTaken, _allocationSites);
+  std::vector<alias_analysis::access> stores;
+  bool unknownStores = false; // through pointers that are not plain array variables
+  for (auto assignment : effects.assignments()) {
+    if (auto store = aliases.describe(assignment->lvalue())) {
+      stores.push_back(*store);
+    } else if (!dynamic_cast<cdk::variable_node*>(assignment->lvalue())) {
+      unknownStores = true;
+    } // else a variable declared in the loop, which no load outside it can reach
+  }
+
+  // the variables a load uses keep their values through the loop
+  auto invariant = [&](const std::string &name) {
+    auto symbol = _symtab.find(name);
+    return symbol != nullptr && !effects.assigned().count(name) && !effects.declared().count(name)
+           && !aliases.addressTaken(symbol);
+  };
+
+  // the accesses of a forwarded element: only its loads and stores (not ?)
+  std::set<til::index_node*> accessed;
+  for (auto assignment : effects.assignments()) {
+    if (auto index = dynamic_cast<til::index_node*>(assignment->lvalue())) accessed.insert(index);
+  }
+  for (auto rvalue : effects.elementLoads()) {
+    accessed.insert(dynamic_cast<til::index_node*>(rvalue->lvalue()));
+  }
+  std::map<std::string, std::vector<til::index_node*>> elements; // forwarded: their accesses
+  auto forwardable = [&](const alias_analysis::access &load) {
+    if (!load.indexed || effects.hasReturns() || effects.hasLoopExits()) {
+      return false;
+    }
+    // the variables the loop reads or writes must be elsewhere too
+    std::set<std::string> scalars(effects.assigned());
+    for (auto &read : effects.reads()) scalars.insert(read.first);
+    for (auto &name : scalars) {
+      if (effects.declared().count(name)) continue; // a local of the loop, which the element was not taken from
+      auto scalar = aliases.describeVariable(name);
+      if (!scalar || aliases.mayAlias(load, *scalar)) return false;
+    }
+    auto key = load.key();
+    std::vector<til::index_node*> accesses;
+    for (auto index : effects.indexes()) {
+      auto other = aliases.describeElement(index);
+      if (!other || (aliases.mayAlias(load, *other) && other->key() != key)) {
+        return false;
+      } else if (other->key() == key) {
+        if (!accessed.count(index) || _forwardedElements.count(index)) return false; // taken with ?, or an outer loop's
+        accesses.push_back(index);
+      }
+    }
+    elements[key] = accesses;
+    return true;
+  };
+
+  std::vector<std::string> keys;
+  std::map<std::string, std::vector<cdk::rvalue_node*>> loads;
+  for (auto rvalue : alias_analysis::everyIteration(node)) {
+    auto load = aliases.describe(rvalue->lvalue());
+    if (!load || (!load->indexed && !load->symbol->global())) {
+      continue; // locals already live in the frame
+    } else if (load->indexed ? !invariant(load->variable) || (load->variableIndex && !invariant(*load->variableIndex))
+                             : effects.assigned().count(load->variable) || effects.declared().count(load->variable)) {
+      continue;
+    } else if (unknownStores && (load->indexed || aliases.addressTaken(load->symbol))) {
+      continue;
+    } else if (std::any_of(stores.begin(), stores.end(), [&](auto &store) { return aliases.mayAlias(*load, store); })
+               && !elements.count(load->key()) && !forwardable(*load)) {
+      continue;
+    }
+
+    auto key = load->key();
+    if (!loads.count(key)) {
+      if (keys.size() == static_cast<size_t>(options::hoistLoads())) continue;
+      keys.push_back(key);
+    }
+    loads[key].push_back(rvalue);
+  }
+  if (keys.empty()) {
+    return std::nullopt;
+  }
+
+  int skipLbl = ++_lbl;
+  acceptCondition(node->condition(), lvl, mklbl(skipLbl), false);
+  for (auto &key : keys) {
+    auto first = loads[key].front();
+    first->accept(this, lvl);
+    _offset -= first->type()->size();
+    _pf.LOCAL(_offset);
+    if (first->is_typed(cdk::TYPE_DOUBLE)) {
+      _pf.STDOUBLE();
+    } else {
+      _pf.STINT();
+    }
+    for (auto rvalue : loads[key]) {
+      _hoistedLoads[rvalue] = _offset;
+      hoisted.push_back(rvalue);
+    }
+    if (elements.count(key)) {
+      forwarded.push_back(dynamic_cast<til::index_node*>(first->lvalue())); // typed: written back through it
+      for (auto index : elements[key]) {
+        _forwardedElements[index] = _offset;
+        forwarded.push_back(index);
+      }
+    }
+  }
+  return skipLbl;
+}
+
+/*
+ * Runs the iterations of a loop on a pool of threads when they are
+ * independent: a counted loop (< i n) with step 1 whose body only writes
+ * its own locals and (index a i) elements, and only reads invariant
+ * variables (which no store to those elements may reach, see
+ * alias_analysis) and elements of the same index. No iteration then reads
+ * what another writes, unless two array variables point into the same
+ * memory at different places: that is checked before the loop, and such
+ * loops run the serial code.
+ *
+ * The body is outlined into code that copies the function's frame (each
+ * thread gets private locals and counter) and runs chunks of iterations
+ * taken from a shared counter until none is left. Short loops (fewer than
+ * TIL_PARALLEL_MIN_TRIP iterations) run the serial code instead.
+*/
+bool til::postfix_writer::parallelizeLoop(til::loop_node * const node, std::optional<std::pair<std::string, int>> entryValue,
+            int lvl) {
+  if (options::maxThreads() < 2 || options::checked() || _inParallelLoop) {
+    return false;
+  }
+
+  auto loop = countedLoop(node);
+  if (!loop || loop->step() != 1 || loop->inclusive() || _addressTaken.count(loop->counter())) {
+    return false;
+  }
+  auto effects = loop->effects();
+  if (effects->hasCalls() || effects->hasIO() || effects->hasAllocs() || effects->hasFunctions()
+      || effects->hasReturns() || effects->hasLoopExits() || !effects->addressTaken().empty()) {
+    return false;
+  }
+
+  // scalars written by an iteration are its own (and shadow nothing)
+  for (auto &name : effects->assigned()) {
+    if (!effects->declared().count(name) || _symtab.find(name) != nullptr) {
+      return false;
+    }
+  }
+  // everything else it reads is left alone by the loop, also through the arrays it stores to
+  alias_analysis aliases(_symtab, _addressTaken, _moduleAddressTaken, _allocationSites);
+  std::vector<alias_analysis::access> stores;
+  for (auto assignment : effects->assignments()) {
+    if (auto index = dynamic_cast<til::index_node*>(assignment->lvalue())) {
+      auto store = aliases.describeElement(index);
+      if (!store) return false;
+      stores.push_back(*store);
+    }
+  }
+  for (auto &read : effects->reads()) {
+    if (effects->declared().count(read.first)) continue;
+    auto load = aliases.describeVariable(read.first);
+    if (!load || std::any_of(stores.begin(), stores.end(), [&](auto &store) { return aliases.mayAlias(*load, store); })) {
+      return false;
+    }
+  }
+
+  std::optional<size_t> elementSize;
+  std::set<std::string> arrays, storedArrays;
+  for (auto index : effects->indexes()) {
+    auto array = counted_loop::readVariable(index->pointer());
+    if (!array || effects->declared().count(*array) || loop->linearOffset(index->index()) != 0) {
+      return false;
+    }
+    arrays.insert(*array);
+    auto symbol = _symtab.find(*array);
+    if (symbol == nullptr || !symbol->is_typed(cdk::TYPE_POINTER)) {
+      return false;
+    }
+    auto referenced = cdk::reference_type::cast(symbol->type())->referenced();
+    size_t size = referenced->name() == cdk::TYPE_UNSPEC ? 4 : referenced->size();
+    if (effects->hasIndexStores() && elementSize && *elementSize != size) {
+      return false;
+    }
+    elementSize = size;
+  }
+  for (auto assignment : effects->assignments()) {
+    if (auto index = dynamic_cast<til::index_node*>(assignment->lvalue())) {
+      storedArrays.insert(*counted_loop::readVariable(index->pointer()));
+    }
+  }
+
+  // the copy of the frame must leave room for the body on a pool thread's stack
+  int copied = (_frameSize + 8 + _argumentsSize + 3) / 4 * 4;
+  if (copied > workerStackSize / 2) {
+    return false;
+  }
+
+  if (_poolLbl == 0) {
+    _poolLbl = ++_lbl;
+    _poolDataLbl = ++_lbl;
+  }
+
+  // the counter's register (see promoteLocals) or frame slot
+  auto counter = promotedRegister(loop->counter()).value_or(
+      "[ebp+" + std::to_string(_symtab.find(loop->counter())->offset()) + "]");
+  int outlinedLbl = ++_lbl, chunkLbl = ++_lbl, fullLbl = ++_lbl, bodyLbl = ++_lbl, testLbl = ++_lbl;
+  int doneLbl = ++_lbl, dispatchLbl = ++_lbl, serialLbl = ++_lbl, endLbl = ++_lbl;
+  auto slot = [&](int below) { return "[ebp-" + std::to_string(_frameSize + below) + "]"; };
+  auto chunk = std::to_string(std::max(1, options::parallelChunk()));
+
+  // outlined iterations: below the frame's copy, the end of the chunk, the
+  // thread's stack pointer and the counter's first value
+  _pf.JMP(mklbl(dispatchLbl));
+  _pf.ALIGN();
+  _pf.LABEL(mklbl(outlinedLbl));
+  asmInstruction("push ebp");
+  asmInstruction("push ebx");
+  asmInstruction("push esi");
+  asmInstruction("push edi");
+  asmInstruction("mov edx, esp");
+  asmInstruction("mov esi, " + poolField(POOL_FRAME));
+  asmInstruction("sub esi, " + std::to_string(_frameSize));
+  asmInstruction("sub esp, " + std::to_string(copied));
+  asmInstruction("mov edi, esp");
+  asmInstruction("mov ecx, " + std::to_string(copied / 4));
+  asmInstruction("rep movsd");
+  asmInstruction("lea ebp, [esp+" + std::to_string(_frameSize) + "]");
+  spillPromoted(true);
+  asmInstruction("sub esp, 12");
+  asmInstruction("mov " + slot(8) + ", edx");
+  asmInstruction("mov eax, " + counter);
+  asmInstruction("mov " + slot(12) + ", eax");
+
+  _pf.LABEL(mklbl(chunkLbl));
+  asmInstruction("mov eax, " + chunk);
+  asmInstruction("lock xadd " + poolField(POOL_NEXT) + ", eax");
+  asmInstruction("cmp eax, " + poolField(POOL_END));
+  asmInstruction("jae " + mklbl(doneLbl));
+  asmInstruction("lea ecx, [eax+" + chunk + "]");
+  asmInstruction("cmp ecx, " + poolField(POOL_END));
+  asmInstruction("jbe " + mklbl(fullLbl));
+  asmInstruction("mov ecx, " + poolField(POOL_END));
+  _pf.LABEL(mklbl(fullLbl));
+  asmInstruction("add eax, " + slot(12));
+  asmInstruction("add ecx, " + slot(12));
+  asmInstruction("mov " + counter + ", eax");
+  asmInstruction("mov " + slot(4) + ", ecx");
+  _pf.JMP(mklbl(testLbl));
+
+  _pf.ALIGN();
+  _pf.LABEL(mklbl(bodyLbl));
+  _inParallelLoop = true;
+  _currentFunctionLoopLabels->push_back(std::make_pair(mklbl(testLbl), mklbl(doneLbl)));
+  acceptLoopBody(node, lvl);
+  _currentFunctionLoopLabels->pop_back();
+  _inParallelLoop = false;
+  _pf.LABEL(mklbl(testLbl));
+  asmInstruction("mov eax, " + counter);
+  asmInstruction("cmp eax, " + slot(4));
+  asmInstruction("jl " + mklbl(bodyLbl));
+  _pf.JMP(mklbl(chunkLbl));
+
+  _pf.LABEL(mklbl(doneLbl));
+  asmInstruction("mov esp, " + slot(8));
+  asmInstruction("pop edi");
+  asmInstruction("pop esi");
+  asmInstruction("pop ebx");
+  asmInstruction("pop ebp");
+  asmInstruction("ret");
+
+  // the calling thread: iterations = bound - i, the counter ends at the bound
+  _pf.LABEL(mklbl(dispatchLbl));
+  loop->bound()->accept(this, lvl);
+
+  // two array variables may be the same memory, shifted (pointer arithmetic):
+  // each stored array must coincide with the others or miss all they reach
+  auto lineno = node->lineno();
+  for (auto &stored : storedArrays) {
+    for (auto &other : arrays) {
+      if (other == stored || (other < stored && storedArrays.count(other))) {
+        continue; // same variable, or pair already checked
+      }
+      int okLbl = ++_lbl;
+      (new cdk::rvalue_node(lineno, new cdk::variable_node(lineno, stored)))->accept(this, lvl);
+      (new cdk::rvalue_node(lineno, new cdk::variable_node(lineno, other)))->accept(this, lvl);
+      asmInstruction("pop eax");
+      asmInstruction("pop edx");
+      asmInstruction("sub eax, edx");
+      asmInstruction("jz " + mklbl(okLbl));
+      asmInstruction("cdq"); // eax = |distance| in bytes
+      asmInstruction("xor eax, edx");
+      asmInstruction("sub eax, edx");
+      asmInstruction("mov ecx, [esp]");
+      asmInstruction("sub ecx, " + counter);
+      asmInstruction("jle " + mklbl(okLbl));
+      asmInstruction("imul ecx, ecx, " + std::to_string(*elementSize));
+      asmInstruction("jo " + mklbl(serialLbl));
+      asmInstruction("cmp eax, ecx");
+      asmInstruction("jb " + mklbl(serialLbl));
+      _pf.LABEL(mklbl(okLbl));
+    }
+  }
+
+  asmInstruction("mov ecx, [esp]");
+  asmInstruction("sub ecx, " + counter);
+  asmInstruction("cmp ecx, " + std::to_string(std::max(1, options::parallelMinTrip())));
+  asmInstruction("jl " + mklbl(serialLbl));
+  spillPromoted(false); // the pool threads copy the frame
+  asmInstruction("mov eax, " + mklbl(outlinedLbl));
+  _pf.CALL(mklbl(_poolLbl));
+  asmInstruction("pop eax");
+  asmInstruction("mov " + counter + ", eax");
+  _pf.JMP(mklbl(endLbl));
+
+  _pf.LABEL(mklbl(serialLbl));
+  _pf.TRASH(4);
+  optimiseLoop(node, entryValue, lvl);
+  _pf.LABEL(mklbl(endLbl));
+  return true;
+}
+
+/*
+ * Parallel loops: the thread pool, emitted once per module. The dispatcher
+ * takes the outlined iterations in eax and their number in ecx. The first
+ * call reads TIL_THREADS from the environment (capped by TIL_MAX_THREADS,
+ * the default, for which stacks are reserved) and starts all but one of
+ * those threads, which then wait (on a futex) for each new job; the
+ * calling thread runs iterations too and returns once every thread is
+ * done. Threads are clones sharing the address space and get SIGKILL when
+ * the main thread exits. Iterations are handed out in chunks from a shared
+ * counter, so idle threads take over the remaining work.
+*/
+void til::postfix_writer::generateThreadPool() {
+  int spawnLbl = ++_lbl, spawnedLbl = ++_lbl, readyLbl = ++_lbl, waitLbl = ++_lbl, returnLbl = ++_lbl;
+  int workerLbl = ++_lbl, idleLbl = ++_lbl, workLbl = ++_lbl, stacksLbl = ++_lbl;
+  int environmentLbl = ++_lbl, digitLbl = ++_lbl, cappedLbl = ++_lbl, countedLbl = ++_lbl, nameLbl = ++_lbl;
+  auto maxThreads = std::to_string(options::maxThreads());
+  _poolEmitted = true;
+
+  _pf.ALIGN();
+  _pf.LABEL(mklbl(_poolLbl));
+  asmInstruction("push ebx");
+  asmInstruction("push esi");
+  asmInstruction("push edi");
+  asmInstruction("mov " + poolField(POOL_FRAME) + ", ebp");
+  asmInstruction("mov " + poolField(POOL_FUNCTION) + ", eax");
+  asmInstruction("mov " + poolField(POOL_END) + ", ecx");
+  asmInstruction("mov dword " + poolField(POOL_NEXT) + ", 0");
+  asmInstruction("cmp dword " + poolField(POOL_STARTED) + ", 0");
+  asmInstruction("jne " + mklbl(readyLbl));
+  asmInstruction("mov dword " + poolField(POOL_STARTED) + ", 1");
+
+  // threads: TIL_THREADS=<n> among the environment strings (envp, from the RTS)
+  asmInstruction("mov dword " + poolField(POOL_THREADS) + ", " + maxThreads);
+  asmInstruction("xor ebx, ebx");
+  _pf.LABEL(mklbl(environmentLbl));
+  asmInstruction("push ebx");
+  _pf.CALL("envp");
+  asmInstruction("add esp, 4");
+  asmInstruction("test eax, eax");
+  asmInstruction("jz " + mklbl(countedLbl));
+  asmInstruction("inc ebx");
+  asmInstruction("mov esi, eax");
+  asmInstruction("mov edi, " + mklbl(nameLbl));
+  asmInstruction("mov ecx, 12");
+  asmInstruction("repe cmpsb"); // stops at the first difference (the string's end, at the latest)
+  asmInstruction("jne " + mklbl(environmentLbl));
+  asmInstruction("xor ecx, ecx");
+  _pf.LABEL(mklbl(digitLbl));
+  asmInstruction("movzx eax, byte [esi]");
+  asmInstruction("sub eax, '0'");
+  asmInstruction("cmp eax, 9");
+  asmInstruction("ja " + mklbl(cappedLbl));
+  asmInstruction("imul ecx, ecx, 10");
+  asmInstruction("add ecx, eax");
+  asmInstruction("inc esi");
+  asmInstruction("cmp ecx, " + maxThreads);
+  asmInstruction("jbe " + mklbl(digitLbl));
+  asmInstruction("mov ecx, " + maxThreads);
+  asmInstruction("jmp " + mklbl(digitLbl));
+  _pf.LABEL(mklbl(cappedLbl));
+  asmInstruction("mov " + poolField(POOL_THREADS) + ", ecx");
+  _pf.LABEL(mklbl(countedLbl));
+  _externalFunctionsToDeclare.insert("envp");
+
+  asmInstruction("mov edi, 1");
+  _pf.LABEL(mklbl(spawnLbl));
+  asmInstruction("cmp edi, " + poolField(POOL_THREADS));
+  asmInstruction("jae " + mklbl(readyLbl));
+  asmInstruction("mov eax, 120");        // clone(CLONE_VM | CLONE_FS | CLONE_FILES | CLONE_SIGHAND, stack)
+  asmInstruction("mov ebx, 0xF00");
+  asmInstruction("mov ecx, edi");
+  asmInstruction("imul ecx, ecx, " + std::to_string(workerStackSize));
+  asmInstruction("add ecx, " + mklbl(stacksLbl));
+  asmInstruction("int 0x80");
+  asmInstruction("test eax, eax");
+  asmInstruction("jz " + mklbl(workerLbl));
+  asmInstruction("js " + mklbl(spawnedLbl)); // the pool is smaller, but still works
+  asmInstruction("inc dword " + poolField(POOL_WORKERS));
+  _pf.LABEL(mklbl(spawnedLbl));
+  asmInstruction("inc edi");
+  asmInstruction("jmp " + mklbl(spawnLbl));
+
+  _pf.LABEL(mklbl(readyLbl));
+  asmInstruction("mov eax, " + poolField(POOL_WORKERS));
+  asmInstruction("mov " + poolField(POOL_PENDING) + ", eax");
+  asmInstruction("lock inc dword " + poolField(POOL_GENERATION));
+  asmInstruction("mov eax, 240");        // futex(generation, FUTEX_WAKE, all)
+  asmInstruction("lea ebx, " + poolField(POOL_GENERATION));
+  asmInstruction("mov ecx, 1");
+  asmInstruction("mov edx, 0x7FFFFFFF");
+  asmInstruction("int 0x80");
+  asmInstruction("call dword " + poolField(POOL_FUNCTION));
+  _pf.LABEL(mklbl(waitLbl));
+  asmInstruction("mov edx, " + poolField(POOL_PENDING));
+  asmInstruction("test edx, edx");
+  asmInstruction("jz " + mklbl(returnLbl));
+  asmInstruction("mov eax, 240");        // futex(pending, FUTEX_WAIT, edx)
+  asmInstruction("lea ebx, " + poolField(POOL_PENDING));
+  asmInstruction("xor ecx, ecx");
+  asmInstruction("xor esi, esi");
+  asmInstruction("int 0x80");
+  asmInstruction("jmp " + mklbl(waitLbl));
+  _pf.LABEL(mklbl(returnLbl));
+  asmInstruction("pop edi");
+  asmInstruction("pop esi");
+  asmInstruction("pop ebx");
+  asmInstruction("ret");
+
+  // a pool thread, on its own stack: [esp] is the last job it ran
+  _pf.LABEL(mklbl(workerLbl));
+  asmInstruction("mov eax, 172");        // prctl(PR_SET_PDEATHSIG, SIGKILL)
+  asmInstruction("mov ebx, 1");
+  asmInstruction("mov ecx, 9");
+  asmInstruction("int 0x80");
+  asmInstruction("push dword 0");
+  _pf.LABEL(mklbl(idleLbl));
+  asmInstruction("mov edx, [esp]");
+  asmInstruction("cmp edx, " + poolField(POOL_GENERATION));
+  asmInstruction("jne " + mklbl(workLbl));
+  asmInstruction("mov eax, 240");        // futex(generation, FUTEX_WAIT, edx)
+  asmInstruction("lea ebx, " + poolField(POOL_GENERATION));
+  asmInstruction("xor ecx, ecx");
+  asmInstruction("xor esi, esi");
+  asmInstruction("int 0x80");
+  asmInstruction("jmp " + mklbl(idleLbl));
+  _pf.LABEL(mklbl(workLbl));
+  asmInstruction("mov eax, " + poolField(POOL_GENERATION));
+  asmInstruction("mov [esp], eax");
+  asmInstruction("call dword " + poolField(POOL_FUNCTION));
+  asmInstruction("lock dec dword " + poolField(POOL_PENDING));
+  asmInstruction("jnz " + mklbl(idleLbl));
+  asmInstruction("mov eax, 240");        // futex(pending, FUTEX_WAKE, 1)
+  asmInstruction("lea ebx, " + poolField(POOL_PENDING));
+  asmInstruction("mov ecx, 1");
+  asmInstruction("mov edx, 1");
+  asmInstruction("int 0x80");
+  asmInstruction("jmp " + mklbl(idleLbl));
+
+  _pf.BSS();
+  _pf.ALIGN();
+  _pf.LABEL(mklbl(_poolDataLbl));
+  _pf.SALLOC(POOL_SIZE);
+  _pf.LABEL(mklbl(stacksLbl));
+  _pf.SALLOC((options::maxThreads() - 1) * workerStackSize);
+  _pf.RODATA();
+  _pf.LABEL(mklbl(nameLbl));
+  _pf.SSTRING("TIL_THREADS=");
+  _pf.TEXT(_functionLabels.top());
+}
+
+/*
+ * Generates a loop with the cheapest code that is known to work for it.
+*/
+void til::postfix_writer::optimiseLoop(til::loop_node * const node, std::optional<std::pair<std::string, int>> entryValue,
+            int lvl) {
+  std::optional<til::counted_loop> loop;
+  if (replaceIdiom(node, lvl)) {
+    // EMPTY: string instructions do the whole loop
+  } else if ((loop = countedLoop(node))) {
+    std::optional<int> start;
+    if (entryValue && entryValue->first == loop->counter()) {
+      start = entryValue->second;
+    }
+
+    if (!unrollFully(*loop, start, lvl)) {
+      if (!vectorizeLoop(*loop, lvl)) { // else the loop below runs whatever is left
+        planPrefetches(*loop);
+      }
+      auto offset = _offset;
+      auto counterPointer = derivePointers(*loop, lvl);
+      if (!unrollLoop(*loop, counterPointer, lvl)) {
+        generateLoop(node, lvl);
+      }
+      releasePointers(*loop, counterPointer, lvl);
+      _offset = offset;
+      _prefetchLoop = nullptr;
+      _prefetches.clear();
+    }
+  } else {
+    generateLoop(node, lvl);
+  }
+}
+
+/*
+ * Checked mode: hoists the index checks of an innermost counted loop.
+ * Accesses (index a (+ i c)) are checked at both ends of the counter's
+ * range and accesses with loop-invariant indices are checked once, before
+ * the loop. When all pass, a copy of the loop without those checks runs
+ * (and can be optimised as usual); otherwise the checked copy runs, so
+ * failures still happen at the exact access.
+*/
+bool til::postfix_writer::versionLoop(til::loop_node * const node, std::optional<std::pair<std::string, int>> entryValue,
+            int lvl) {
+  auto loop = countedLoop(node);
+  if (!loop || loop->effects()->hasLoops() || loop->effects()->hasFunctions()) {
+    return false;
+  }
+  auto effects = loop->effects();
+
+  auto invariantVariable = [&](const std::string &name) {
+    auto symbol = _symtab.find(name);
+    return symbol != nullptr && !_addressTaken.count(name) && !effects->assigned().count(name)
+           && !effects->declared().count(name) && !(symbol->global() && (effects->hasCalls() || effects->hasIndexStores()));
+  };
+
+  // accesses whose checks can be hoisted, with the counter offset (if indexed by the counter)
+  std::vector<std::pair<til::index_node*, std::optional<int>>> checks;
+  for (auto index : effects->indexes()) {
+    auto array = counted_loop::readVariable(index->pointer());
+    if (!array || !invariantVariable(*array) || !_symtab.find(*array)->is_typed(cdk::TYPE_POINTER)
+        || !needsIndexCheck(index)) {
+      continue;
+    }
+
+    if (auto offset = loop->linearOffset(index->index())) {
+      checks.push_back(std::make_pair(index, offset));
+    } else if (dynamic_cast<cdk::integer_node*>(index->index())) {
+      checks.push_back(std::make_pair(index, std::nullopt));
+    } else if (auto name = counted_loop::readVariable(index->index());
+               name && invariantVariable(*name) && _symtab.find(*name)->is_typed(cdk::TYPE_INT)) {
+      checks.push_back(std::make_pair(index, std::nullopt));
+    }
+  }
+  if (checks.empty()) {
+    return false;
+  }
+
+  // the range of the counter is [i, bound - 1] (or reversed, or with the bound itself)
+  int last = loop->inclusive() ? 0 : loop->ascending() ? -1 : 1;
+  int checkedLbl = ++_lbl, endLbl = ++_lbl;
+
+  for (auto &check : checks) {
+    auto index = check.first;
+    auto referenced = cdk::reference_type::cast(_symtab.find(*counted_loop::readVariable(index->pointer()))->type())->referenced();
+    size_t size = referenced->name() == cdk::TYPE_UNSPEC ? 4 : referenced->size();
+
+    index->pointer()->accept(this, lvl);
+    if (check.second) {
+      dynamic_cast<cdk::binary_operation_node*>(node->condition())->left()->accept(this, lvl);
+      _pf.INT(*check.second);
+      _pf.ADD();
+      loop->bound()->accept(this, lvl);
+      _pf.INT(*check.second + last);
+      _pf.ADD();
+    } else {
+      index->index()->accept(this, lvl);
+      _pf.DUP32();
+    }
+
+    // stack: last index, first index, array
+    checkIndex(8, 4, size, mklbl(checkedLbl));
+    checkIndex(8, 0, size, mklbl(checkedLbl));
+    _pf.TRASH(12);
+  }
+
+  for (auto &check : checks) {
+    _uncheckedIndexes.insert(check.first);
+  }
+  optimiseLoop(node, entryValue, lvl);
+  for (auto &check : checks) {
+    _uncheckedIndexes.erase(check.first);
+  }
+  _pf.JMP(mklbl(endLbl));
+
+  // some check failed: the stack still holds its operands
+  _pf.LABEL(mklbl(checkedLbl));
+  _pf.TRASH(12);
+  optimiseLoop(node, entryValue, lvl);
+  _pf.LABEL(mklbl(endLbl));
+  return true;
+}
+
+/*
+ * Loop fusion: a counted loop followed by a reset of its counter to the
+ * same starting value and by another counted loop with the same condition
+ * and step becomes one loop running both bodies, so arrays stream through
+ * the cache once. Iteration i of the second body now runs before iteration
+ * j > i of the first one, which is only allowed when they cannot depend on
+ * each other:
+ *
+ *   - scalars written by one body are not used by the other;
+ *   - array elements written by one body are not accessed by the other,
+ *     except through the same array variable at i + c, with the second
+ *     body's c not past the first's in the direction the counter moves
+ *     (that element is then already final);
+ *   - neither body calls, does IO, allocates, leaves the loop or fails
+ *     index checks (that would change which effects happen first).
+ *
+ * The counter ends with the same value, so the reset is dropped. Loops the
+ * string instructions handle (see replaceIdiom) are left alone.
+*/
+til::loop_node *til::postfix_writer::fuseLoops(til::loop_node * const first, cdk::basic_node * const reset,
+            cdk::basic_node * const second, std::optional<std::pair<std::string, int>> entryValue) {
+  auto next = dynamic_cast<til::loop_node*>(second);
+  auto evaluation = dynamic_cast<til::evaluation_node*>(reset);
+  auto assignment = evaluation ? dynamic_cast<cdk::assignment_node*>(evaluation->argument()) : nullptr;
+  if (options::fuseLoops() <= 0 || options::checked() || next == nullptr || assignment == nullptr || !entryValue) {
+    return nullptr;
+  }
+
+  // the conditions are typed here (errors are reported when they are generated)
+  try {
+    type_checker checker(_compiler, _symtab, this);
+    first->accept(&checker, 0);
+    next->accept(&checker, 0);
+  } catch (const std::string &) {
+    return nullptr;
+  }
+
+  auto a = countedLoop(first), b = countedLoop(next);
+  if (!a || !b || a->counter() != b->counter() || a->step() != b->step() || a->inclusive() != b->inclusive()
+      || typeid(*first->condition()) != typeid(*next->condition()) || entryValue->first != a->counter()) {
+    return nullptr;
+  }
+  auto startValue = dynamic_cast<cdk::integer_node*>(assignment->rvalue());
+  auto resetVariable = dynamic_cast<cdk::variable_node*>(assignment->lvalue());
+  if (startValue == nullptr || startValue->value() != entryValue->second || resetVariable == nullptr
+      || resetVariable->name() != a->counter()) {
+    return nullptr;
+  }
+  auto literalA = dynamic_cast<cdk::integer_node*>(a->bound()), literalB = dynamic_cast<cdk::integer_node*>(b->bound());
+  if (literalA && literalB ? literalA->value() != literalB->value() : a->boundVariable() != b->boundVariable()) {
+    return nullptr;
+  }
+  if (loop_idiom::recognise(_compiler, first) || loop_idiom::recognise(_compiler, next)) {
+    return nullptr;
+  }
+
+  auto effectsA = a->effects(), effectsB = b->effects();
+  for (auto effects : { effectsA, effectsB }) {
+    if (effects->hasCalls() || effects->hasIO() || effects->hasAllocs() || effects->hasFunctions()
+        || effects->hasReturns() || effects->hasLoopExits() || !effects->addressTaken().empty()) {
+      return nullptr;
+    }
+  }
+
+  // scalars: what one body writes, the other neither reads nor writes (locals of either body are their own)
+  auto own = [](til::block_node *body) {
+    std::set<std::string> names;
+    for (size_t i = 0; i < body->declarations()->size(); i++) {
+      names.insert(dynamic_cast<til::declaration_node*>(body->declarations()->node(i))->identifier());
+    }
+    return names;
+  };
+  auto ownA = own(a->body()), ownB = own(b->body());
+  auto used = [](const std::shared_ptr<effect_analyser> &effects, const std::string &name) {
+    return effects->reads(name) > 0 || effects->assigned().count(name) > 0 || effects->declared().count(name) > 0;
+  };
+  for (auto &name : effectsA->assigned()) {
+    if (!ownA.count(name) && !ownB.count(name) && used(effectsB, name)) return nullptr;
+  }
+  for (auto &name : effectsB->assigned()) {
+    if (!ownA.count(name) && !ownB.count(name) && used(effectsA, name)) return nullptr;
+  }
+
+  // pointers may lead to the variables used with ?
+  alias_analysis aliases(_symtab, _addressTaken, _moduleAddressTaken, _allocationSites);
+  auto reachable = [&](const std::shared_ptr<effect_analyser> &effects) {
+    auto names = effects->assigned();
+    for (auto &read : effects->reads()) names.insert(read.first);
+    return std::any_of(names.begin(), names.end(), [&](auto &name) {
+      auto symbol = _symtab.find(name);
+      return symbol != nullptr && aliases.addressTaken(symbol);
+    });
+  };
+  if ((reachable(effectsA) && !effectsB->indexes().empty()) || (reachable(effectsB) && !effectsA->indexes().empty())) {
+    return nullptr;
+  }
+
+  // arrays: every pair of accesses where one of them stores
+  auto stores = [](const std::shared_ptr<effect_analyser> &effects) {
+    std::set<cdk::lvalue_node*> result;
+    for (auto store : effects->assignments()) result.insert(store->lvalue());
+    return result;
+  };
+  auto changed = [&](const std::string &name) {
+    return effectsA->assigned().count(name) || effectsA->declared().count(name)
+           || effectsB->assigned().count(name) || effectsB->declared().count(name);
+  };
+  auto storesA = stores(effectsA), storesB = stores(effectsB);
+  for (auto index : effectsA->indexes()) {
+    for (auto other : effectsB->indexes()) {
+      if (!storesA.count(index) && !storesB.count(other)) {
+        continue;
+      }
+      auto access = aliases.describeElement(index), otherAccess = aliases.describeElement(other);
+      if (!access || !otherAccess || changed(access->variable) || changed(otherAccess->variable)) {
+        return nullptr;
+      }
+      if (access->symbol == otherAccess->symbol) {
+        auto offset = a->linearOffset(index->index()), otherOffset = b->linearOffset(other->index());
+        if (!offset || !otherOffset || (a->step() > 0 ? *otherOffset > *offset : *otherOffset < *offset)) {
+          return nullptr; // the second body would get ahead of the first
+        }
+      } else if (aliases.mayAlias(*access, *otherAccess)) {
+        return nullptr;
+      }
+    }
+  }
+
+  // the bodies, without their increments (nested when they declare variables)
+  auto lineno = first->lineno();
+  auto instructions = new cdk::sequence_node(lineno);
+  for (auto body : { a->body(), b->body() }) {
+    auto statements = new cdk::sequence_node(lineno);
+    for (size_t i = 0; i + 1 < body->instructions()->size(); i++) {
+      statements = new cdk::sequence_node(lineno, body->instructions()->node(i), statements);
+    }
+    if (!ownA.empty() || !ownB.empty()) {
+      instructions = new cdk::sequence_node(lineno, new til::block_node(lineno, body->declarations(), statements), instructions);
+    } else {
+      for (size_t i = 0; i < statements->size(); i++) {
+        instructions = new cdk::sequence_node(lineno, statements->node(i), instructions);
+      }
+    }
+  }
+  instructions = new cdk::sequence_node(lineno, a->increment(), instructions);
+  return new til::loop_node(lineno, first->condition(),
+                            new til::block_node(lineno, new cdk::sequence_node(lineno), instructions));
+}
+
+void til::postfix_writer::generateLoop(til::loop_node * const node, int lvl) {
+  int bodyLbl, condLbl = ++_lbl, endLbl = ++_lbl;
+
+  // rotated loop: the condition is tested once on entry and then at the
+  // bottom of each iteration, with a single conditional branch back
+  acceptCondition(node->condition(), lvl, mklbl(endLbl), false);
+
+  // loop body (the only label that is aligned, as it is the hot branch target)
+  _pf.ALIGN();
+  _pf.LABEL(mklbl(bodyLbl = ++_lbl));
+  _currentFunctionLoopLabels->push_back(std::make_pair(mklbl(condLbl), mklbl(endLbl)));
+  acceptLoopBody(node, lvl);
+  _currentFunctionLoopLabels->pop_back();
+
+  // "next" continues here
+  _pf.LABEL(mklbl(condLbl));
+  acceptCondition(node->condition(), lvl, mklbl(bodyLbl), true);
+  _pf.LABEL(mklbl(endLbl));
+}
+
+/*
+ * Checks a syntactically counted loop against the symbol table: the counter
+ * must be a local int that no pointer can reach, and the bound must not
+ * change while the loop runs.
+*/
+std::optional<til::counted_loop> til::postfix_writer::countedLoop(til::loop_node * const node) {
+  auto loop = counted_loop::recognise(_compiler, node);
+  if (!loop) {
+    return std::nullopt;
+  }
+
+  auto condition = dynamic_cast<cdk::binary_operation_node*>(node->condition());
+  if (!condition->left()->is_typed(cdk::TYPE_INT) || !condition->right()->is_typed(cdk::TYPE_INT)) {
+    return std::nullopt;
+  }
+
+  auto counter = _symtab.find(loop->counter());
+  if (counter == nullptr || counter->global() || _addressTaken.count(loop->counter())) {
+    return std::nullopt;
+  }
+
+  if (loop->boundVariable()) {
+    auto bound = _symtab.find(*loop->boundVariable());
+    if (bound == nullptr || _addressTaken.count(bound->name())) {
+      return std::nullopt;
+    } else if (bound->global() && (loop->effects()->hasCalls() || loop->effects()->hasIndexStores())) {
+      return std::nullopt;
+    }
+  }
+
+  return loop;
+}
+
+/*
+ * Generates a copy of the loop body. Copies run one after the other, so
+ * they all reuse the frame slots of the body's declarations. Pointers
+ * derived from the counter move to the next iteration after each copy.
+*/
+void til::postfix_writer::acceptLoopBody(til::loop_node * const node, int lvl) {
+  if (_prefetchLoop != nullptr && _prefetchLoop->loop() == node) {
+    prefetchAhead(lvl);
+  }
+
+  auto offset = _offset;
+  node->block()->accept(this, lvl + 2);
+  _visitedFinalInstruction = false;
+  _offset = offset;
+
+  for (auto &increment : _pointerIncrements) {
+    _pf.LOCAL(increment.first);
+    _pf.LDINT();
+    _pf.INT(increment.second);
+    _pf.ADD();
+    _pf.LOCAL(increment.first);
+    _pf.STINT();
+  }
+}
+
+/*
+ * Unrolls a counted loop with a small constant trip count completely
+ * (unless unrolling is disabled).
+*/
+bool til::postfix_writer::unrollFully(const til::counted_loop &loop, std::optional<int> start, int lvl) {
+  auto effects = loop.effects();
+  if (!start || options::unrollFactor() < 2 || effects->hasFunctions() || effects->nodes() > static_cast<size_t>(options::unrollMaxNodes())) {
+    return false;
+  }
+
+  auto trips = loop.tripCount(*start);
+  if (!trips || *trips > options::fullUnrollLimit()) {
+    return false;
+  }
+
+  for (long long i = 0; i < *trips; i++) {
+    acceptLoopBody(loop.loop(), lvl);
+  }
+  return true;
+}
+
+/*
+ * Unrolls a counted loop: a loop running several copies of the body per
+ * test is followed by the original loop, which runs the remaining iterations.
+*/
+bool til::postfix_writer::unrollLoop(const til::counted_loop &loop, std::optional<size_t> counterPointer, int lvl) {
+  auto effects = loop.effects();
+  if (effects->hasFunctions() || effects->nodes() > static_cast<size_t>(options::unrollMaxNodes())) {
+    return false;
+  }
+
+  int factor = options::unrollFactor();
+  if (factor < 2) {
+    return false;
+  }
+
+  // the unrolled loop runs while the last copy in it would still run,
+  // i.e., while (i OP bound - (factor - 1) * step)
+  auto lineno = loop.loop()->lineno();
+  long long distance = static_cast<long long>(factor - 1) * loop.step();
+  if (distance < std::numeric_limits<int>::min() || distance > std::numeric_limits<int>::max()) {
+    return false;
+  }
+  cdk::expression_node *bound;
+
+  if (auto literal = dynamic_cast<cdk::integer_node*>(loop.bound())) {
+    long long value = literal->value() - distance;
+    if (value < std::numeric_limits<int>::min() || value > std::numeric_limits<int>::max()) {
+      return false;
+    }
+    bound = new cdk::integer_node(lineno, static_cast<int>(value));
+  } else {
+    bound = new cdk::sub_node(lineno, loop.bound(), new cdk::integer_node(lineno, static_cast<int>(distance)));
+  }
+  auto condition = loop.condition(bound);
+  if (counterPointer) {
+    replaceCounterTest(loop, *counterPointer, condition, bound, lvl);
+  }
+
+  int bodyLbl, endLbl = ++_lbl;
+  if (!dynamic_cast<cdk::integer_node*>(loop.bound())) {
+    // a bound near the ends of int leaves everything to the original loop
+    loop.bound()->accept(this, lvl);
+    asmInstruction("pop eax");
+    asmInstruction("sub eax, " + std::to_string(distance));
+    asmInstruction("jo " + mklbl(endLbl));
+  }
+  acceptCondition(condition, lvl, mklbl(endLbl), false);
+
+  _pf.ALIGN();
+  _pf.LABEL(mklbl(bodyLbl = ++_lbl));
+  for (int i = 0; i < factor; i++) {
+    acceptLoopBody(loop.loop(), lvl);
+  }
+  acceptCondition(condition, lvl, mklbl(bodyLbl), true);
+  _pf.LABEL(mklbl(endLbl));
+
+  // remaining iterations
+  generateLoop(loop.loop(), lvl);
+  return true;
+}
+
+/*
+ * Strength-reduces the indexed accesses of a counted loop: the accesses to
+ * an array at (+ i c) share a pointer that starts at the first element the
+ * loop touches and moves by step elements per iteration, so they no longer
+ * multiply by the element size. A pointer pays for its increment when it
+ * serves several accesses, or when it replaces every use of the counter:
+ * the counter is then dead inside the loop, its increment is dropped and
+ * the loop tests compare the pointer with its end value instead.
+ * Returns the index of the pointer that replaces the counter, if any.
+*/
+std::optional<size_t> til::postfix_writer::derivePointers(const til::counted_loop &loop, int lvl) {
+  auto effects = loop.effects();
+  std::vector<size_t> candidates;
+  size_t accesses = 0;
+
+  for (size_t i = 0; i < loop.derivedPointers().size(); i++) {
+    auto &pointer = loop.derivedPointers()[i];
+    auto array = _symtab.find(pointer.array);
+    if (array == nullptr || !array->is_typed(cdk::TYPE_POINTER) || _addressTaken.count(pointer.array)) {
+      continue;
+    } else if (array->global() && (effects->hasCalls() || effects->hasIndexStores())) {
+      continue; // the array variable itself may change behind our back
+    }
+
+    auto referenced = cdk::reference_type::cast(array->type())->referenced();
+    if (referenced->name() != cdk::TYPE_UNSPEC && referenced->size() == 0) {
+      continue;
+    }
+
+    if (std::any_of(pointer.accesses.begin(), pointer.accesses.end(), [&](auto access) { return needsIndexCheck(access); })) {
+      continue;
+    }
+
+    candidates.push_back(i);
+    accesses += pointer.accesses.size();
+  }
+
+  // gathers prefetched ahead (see planPrefetches) read the counter too
+  bool counterDead = !candidates.empty() && accesses == effects->reads(loop.counter())
+                     && std::none_of(_prefetches.begin(), _prefetches.end(), [](auto &p) { return p.gather != nullptr; });
+
+  std::optional<size_t> counterPointer;
+  for (auto i : candidates) {
+    auto &pointer = loop.derivedPointers()[i];
+    if (!counterDead && pointer.accesses.size() < 2) {
+      continue;
+    }
+
+    // initial address, computed by the access itself
+    auto first = pointer.accesses.front();
+    first->accept(this, lvl);
+    _offset -= 4;
+    _pf.LOCAL(_offset);
+    _pf.STINT();
+
+    for (auto access : pointer.accesses) {
+      _derivedPointers[access] = _offset;
+    }
+    _pointerIncrements.push_back(std::make_pair(_offset, loop.step() * static_cast<int>(first->type()->size())));
+
+    if (counterDead && !counterPointer) {
+      counterPointer = i;
+    }
+  }
+
+  if (counterPointer) {
+    _elidedInstructions.insert(loop.increment());
+    replaceCounterTest(loop, *counterPointer, loop.loop()->condition(), loop.bound(), lvl);
+  }
+  return counterPointer;
+}
+
+/*
+ * Computes, before the loop, the address the counter's pointer reaches
+ * together with the counter reaching bound, and makes the given test of the
+ * counter compare the pointer with it.
+*/
+void til::postfix_writer::replaceCounterTest(const til::counted_loop &loop, size_t counterPointer,
+            cdk::expression_node * const condition, cdk::expression_node * const bound, int lvl) {
+  auto &pointer = loop.derivedPointers()[counterPointer];
+  auto first = pointer.accesses.front();
+  auto lineno = condition->lineno();
+
+  auto end = new til::index_node(lineno, first->pointer(),
+                                 new cdk::add_node(lineno, bound, new cdk::integer_node(lineno, pointer.offset)));
+  end->accept(this, lvl);
+  _offset -= 4;
+  _pf.LOCAL(_offset);
+  _pf.STINT();
+
+  _pointerTests[condition] = std::make_pair(_derivedPointers.at(first), _offset);
+}
+
+/*
+ * Forgets the pointers of a counted loop. A dead counter was not updated by
+ * the loop, so its final value is recovered from its pointer.
+*/
+void til::postfix_writer::releasePointers(const til::counted_loop &loop, std::optional<size_t> counterPointer, int lvl) {
+  if (counterPointer) {
+    auto &pointer = loop.derivedPointers()[*counterPointer];
+    auto first = pointer.accesses.front();
+
+    // i = (p - a) / size - c
+    _pf.LOCAL(_derivedPointers.at(first));
+    _pf.LDINT();
+    first->pointer()->accept(this, lvl);
+    _pf.SUB();
+    _pf.INT(first->type()->size());
+    _pf.DIV();
+    if (pointer.offset != 0) {
+      _pf.INT(pointer.offset);
+      _pf.SUB();
+    }
+    if (auto reg = promotedRegister(loop.counter())) {
+      asmInstruction("pop " + *reg);
+    } else {
+      _pf.LOCAL(_symtab.find(loop.counter())->offset());
+      _pf.STINT();
+    }
+
+    _elidedInstructions.erase(loop.increment());
+    std::erase_if(_pointerTests, [&](auto &test) { return test.second.first == _derivedPointers.at(first); });
+  }
+
+  for (auto &pointer : loop.derivedPointers()) {
+    for (auto access : pointer.accesses) {
+      _derivedPointers.erase(access);
+    }
+  }
+}
+
+/*
+ * Software prefetching for innermost counted loops. The hardware prefetcher
+ * follows addresses in sequence: it cannot guess gathers such as
+ * (index a (index b (+ i c))), and strides of a cache line or more leave it
+ * little time. Each copy of the body starts by prefetching what those
+ * accesses will read TIL_PREFETCH_DISTANCE iterations later. Prefetching
+ * never faults, but the address of a gather comes from loading b ahead:
+ * that load is clamped to the last iteration, so it is only done when
+ * every iteration reads b (step 1, no returns, outside conditionals).
+*/
+void til::postfix_writer::planPrefetches(const til::counted_loop &loop) {
+  _prefetches.clear();
+  auto effects = loop.effects();
+  if (options::prefetchDistance() <= 0 || effects->hasLoops() || effects->hasFunctions()) {
+    return;
+  }
+
+  // elements of a loop-invariant array (when a scaled index can address them)
+  auto invariantArray = [&](cdk::expression_node *pointer) -> std::optional<std::pair<size_t, bool>> {
+    auto name = counted_loop::readVariable(pointer);
+    auto symbol = name ? _symtab.find(*name) : nullptr;
+    if (symbol == nullptr || !symbol->is_typed(cdk::TYPE_POINTER) || _addressTaken.count(*name)
+        || effects->assigned().count(*name) || effects->declared().count(*name)
+        || (symbol->global() && (effects->hasCalls() || effects->hasIndexStores()))) {
+      return std::nullopt;
+    }
+    auto referenced = cdk::reference_type::cast(symbol->type())->referenced();
+    size_t size = referenced->name() == cdk::TYPE_UNSPEC ? 4 : referenced->size();
+    if (size != 1 && size != 2 && size != 4 && size != 8) {
+      return std::nullopt;
+    }
+    return std::make_pair(size, referenced->name() == cdk::TYPE_INT); // size, holds ints
+  };
+  std::set<std::string> planned; // one prefetch per array and cache line (or gather)
+
+  for (auto index : effects->indexes()) {
+    auto offset = loop.linearOffset(index->index());
+    auto array = invariantArray(index->pointer());
+    if (!offset || !array || std::abs(loop.step()) * static_cast<int>(array->first) < cacheLineSize) {
+      continue;
+    }
+    auto key = *counted_loop::readVariable(index->pointer()) + "@"
+               + std::to_string(*offset * static_cast<int>(array->first) / cacheLineSize);
+    if (planned.insert(key).second) {
+      _prefetches.push_back({ index, nullptr, *offset, array->first });
+    }
+  }
+
+  if (std::abs(loop.step()) != 1 || effects->hasReturns()) {
+    return;
+  }
+  std::vector<cdk::basic_node*> statements;
+  for (size_t i = 0; i < loop.body()->declarations()->size(); i++) {
+    statements.push_back(dynamic_cast<til::declaration_node*>(loop.body()->declarations()->node(i))->initializer());
+  }
+  for (size_t i = 0; i < loop.body()->instructions()->size(); i++) {
+    auto instruction = loop.body()->instructions()->node(i);
+    if (instruction != loop.increment() && !isInstanceOf<til::if_node, til::if_else_node, til::block_node>(instruction)) {
+      statements.push_back(instruction);
+    }
+  }
+
+  for (auto statement : statements) {
+    effect_analyser statementEffects(_compiler);
+    if (statement != nullptr) statement->accept(&statementEffects, 0);
+    if (statementEffects.hasShortCircuits()) {
+      continue;
+    }
+    for (auto index : statementEffects.indexes()) {
+      auto gather = dynamic_cast<til::index_node*>(index->index());
+      auto offset = gather ? loop.linearOffset(gather->index()) : std::nullopt;
+      auto array = invariantArray(index->pointer());
+      auto indices = offset ? invariantArray(gather->pointer()) : std::nullopt;
+      if (!array || !indices || !indices->second || needsIndexCheck(gather)) {
+        continue;
+      }
+      auto key = *counted_loop::readVariable(index->pointer()) + "[" + *counted_loop::readVariable(gather->pointer())
+                 + "@" + std::to_string(*offset);
+      if (planned.insert(key).second) {
+        _prefetches.push_back({ index, gather, *offset, array->first });
+      }
+    }
+  }
+
+  if (!_prefetches.empty()) {
+    _prefetchLoop = &loop;
+  }
+}
+
+/*
+ * Emits the prefetches planned for the current body copy. Derived pointers
+ * (see derivePointers) already hold the address of the current element.
+*/
+void til::postfix_writer::prefetchAhead(int lvl) {
+  auto &loop = *_prefetchLoop;
+  long long distance = options::prefetchDistance();
+  auto counter = dynamic_cast<cdk::binary_operation_node*>(loop.loop()->condition())->left();
+  auto displacement = [](long long bytes) { return (bytes < 0 ? "" : "+") + std::to_string(bytes); };
+
+  for (auto &p : _prefetches) {
+    if (p.gather == nullptr) {
+      if (auto derived = _derivedPointers.find(p.access); derived != _derivedPointers.end()) {
+        _pf.LOCAL(derived->second);
+        _pf.LDINT();
+        asmInstruction("pop eax");
+        asmInstruction("prefetcht0 [eax" + displacement(distance * loop.step() * p.size) + "]");
+      } else {
+        p.access->pointer()->accept(this, lvl);
+        counter->accept(this, lvl);
+        asmInstruction("pop eax");
+        asmInstruction("pop ecx");
+        asmInstruction("prefetcht0 [ecx+eax*" + std::to_string(p.size)
+                       + displacement((p.offset + distance * loop.step()) * static_cast<long long>(p.size)) + "]");
+      }
+      continue;
+    }
+
+    // index the gather reads min(distance, iterations left after this one) iterations ahead
+    p.access->pointer()->accept(this, lvl);
+    p.gather->pointer()->accept(this, lvl);
+    counter->accept(this, lvl);
+    loop.bound()->accept(this, lvl);
+    asmInstruction("pop edx");
+    asmInstruction("pop eax");
+    asmInstruction(loop.ascending() ? "mov ecx, edx" : "mov ecx, eax");
+    asmInstruction(loop.ascending() ? "sub ecx, eax" : "sub ecx, edx");
+    if (!loop.inclusive()) {
+      asmInstruction("dec ecx");
+    }
+    asmInstruction("mov edx, " + std::to_string(distance));
+    asmInstruction("cmp ecx, edx");
+    asmInstruction("cmova ecx, edx");
+    asmInstruction(loop.ascending() ? "add eax, ecx" : "sub eax, ecx");
+    asmInstruction("pop ecx");
+    asmInstruction("mov eax, [ecx+eax*4" + displacement(4LL * p.offset) + "]");
+    asmInstruction("pop ecx");
+    asmInstruction("prefetcht0 [ecx+eax*" + std::to_string(p.size) + "]");
+  }
+}
+
+/*
+ * Replaces fill, copy and search loops (see loop_idiom) by the x86 string
+ * instructions (rep stosd, rep movsd and repne scasd), which process the
+ * whole range [i, n) and leave the counter where the loop would. The
+ * operands are pushed by the postfix machine. Double arrays overlapping at
+ * half a double cannot be copied by words: the original loop is kept for them.
+*/
+bool til::postfix_writer::replaceIdiom(til::loop_node * const node, int lvl) {
+  auto idiom = loop_idiom::recognise(_compiler, node);
+  if (!idiom || needsIndexCheck(idiom->target()) || (idiom->source() && needsIndexCheck(idiom->source()))) {
+    return false;
+  }
+
+  auto counter = _symtab.find(idiom->counter());
+  if (counter == nullptr || counter->global() || !counter->is_typed(cdk::TYPE_INT) || _addressTaken.count(counter->name())) {
+    return false;
+  }
+
+  // variables are read once: the stores must not reach them
+  bool stores = idiom->what() != loop_idiom::SEARCH;
+  auto invariantVariable = [&](cdk::expression_node *expression, cdk::typename_type type) {
+    auto name = counted_loop::readVariable(expression);
+    if (!name) {
+      return true; // a literal
+    }
+    auto symbol = _symtab.find(*name);
+    return symbol != nullptr && symbol->is_typed(type) && !_addressTaken.count(*name) && !(stores && symbol->global());
+  };
+  auto elementType = [&](til::index_node *index) -> std::shared_ptr<cdk::basic_type> {
+    auto array = _symtab.find(*counted_loop::readVariable(index->pointer()));
+    if (array == nullptr || !array->is_typed(cdk::TYPE_POINTER) || _addressTaken.count(array->name())) {
+      return nullptr;
+    }
+    return cdk::reference_type::cast(array->type())->referenced();
+  };
+
+  if (dynamic_cast<cdk::double_node*>(idiom->bound()) || dynamic_cast<til::nullptr_node*>(idiom->bound())
+      || !invariantVariable(idiom->bound(), cdk::TYPE_INT)) {
+    return false;
+  }
+
+  auto element = elementType(idiom->target());
+  if (element == nullptr || (element->size() != 4 && element->size() != 8)) {
+    return false;
+  }
+  auto value = idiom->value();
+  auto typeName = element->name();
+
+  if (idiom->what() == loop_idiom::COPY) {
+    auto source = elementType(idiom->source());
+    if (source == nullptr || source->name() != typeName || source->size() != element->size()) {
+      return false;
+    }
+  } else if (element->size() == 8) {
+    // only zero has the same bit pattern in both words (and SEARCH only compares ints)
+    auto integer = dynamic_cast<cdk::integer_node*>(value);
+    auto real = dynamic_cast<cdk::double_node*>(value);
+    if (idiom->what() == loop_idiom::SEARCH || typeName != cdk::TYPE_DOUBLE || !((integer && integer->value() == 0)
+                                                                                || (real && real->value() == 0 && !std::signbit(real->value())))) {
+      return false;
+    }
+    value = nullptr;
+  } else if (dynamic_cast<cdk::integer_node*>(value)) {
+    if (typeName != cdk::TYPE_INT) return false;
+  } else if (dynamic_cast<til::nullptr_node*>(value)) {
+    if (typeName != cdk::TYPE_POINTER || idiom->what() == loop_idiom::SEARCH) return false;
+  } else if (dynamic_cast<cdk::double_node*>(value) || !invariantVariable(value, typeName)
+             || (idiom->what() == loop_idiom::SEARCH && typeName != cdk::TYPE_INT)) {
+    return false;
+  }
+
+  // stack: n, i, a, b or v (top first)
+  auto second = idiom->what() == loop_idiom::COPY ? idiom->source()->pointer() : value;
+  if (second != nullptr) {
+    second->accept(this, lvl);
+  } else {
+    _pf.INT(0);
+  }
+  idiom->target()->pointer()->accept(this, lvl);
+  idiom->counterValue()->accept(this, lvl);
+  idiom->bound()->accept(this, lvl);
+
+  int scale = element->size(), words = element->size() / 4;
+  int skipLbl = ++_lbl, fallbackLbl = ++_lbl, endLbl = ++_lbl;
+  bool fallback = idiom->what() == loop_idiom::COPY && words == 2;
+
+  asmInstruction("mov ecx, [esp]");
+  asmInstruction("mov edx, [esp+4]");
+  asmInstruction("cmp edx, ecx");
+  asmInstruction("jge " + mklbl(skipLbl)); // the loop would do nothing
+  asmInstruction("sub ecx, edx"); // elements left
+  if (fallback) {
+    // rep movsd copies words: doubles must not overlap at half a double
+    asmInstruction("mov eax, [esp+8]");
+    asmInstruction("sub eax, [esp+12]");
+    asmInstruction("test eax, 7");
+    asmInstruction("jnz " + mklbl(fallbackLbl));
+  }
+  if (words == 2) {
+    asmInstruction("shl ecx, 1");
+  }
+
+  if (idiom->what() == loop_idiom::COPY) {
+    // forward copy, word by word, exactly like the loop (even when overlapping)
+    asmInstruction("push esi");
+    asmInstruction("push edi");
+    asmInstruction("mov eax, [esp+16]");
+    asmInstruction("lea edi, [eax+edx*" + std::to_string(scale) + "]");
+    asmInstruction("mov eax, [esp+20]");
+    asmInstruction("lea esi, [eax+edx*" + std::to_string(scale) + "]");
+    asmInstruction("rep movsd");
+    asmInstruction("pop edi");
+    asmInstruction("pop esi");
+    asmInstruction("push dword [esp]"); // i = n
+  } else if (idiom->what() == loop_idiom::FILL) {
+    asmInstruction("push edi");
+    asmInstruction("mov eax, [esp+12]");
+    asmInstruction("lea edi, [eax+edx*" + std::to_string(scale) + "]");
+    asmInstruction("mov eax, [esp+16]");
+    asmInstruction("rep stosd");
+    asmInstruction("pop edi");
+    asmInstruction("push dword [esp]"); // i = n
+  } else {
+    int foundLbl = ++_lbl;
+    asmInstruction("push edi");
+    asmInstruction("mov eax, [esp+12]");
+    asmInstruction("lea edi, [eax+edx*4]");
+    asmInstruction("mov eax, [esp+16]");
+    asmInstruction("repne scasd");
+    asmInstruction("lea eax, [edi-4]"); // last element compared
+    asmInstruction("pop edi");
+    asmInstruction("je " + mklbl(foundLbl));
+    asmInstruction("push dword [esp]"); // not found: i = n
+    storeValue(idiom->counterLvalue(), false, lvl);
+    _pf.TRASH(16);
+    _pf.JMP(mklbl(endLbl));
+
+    _pf.LABEL(mklbl(foundLbl));
+    asmInstruction("sub eax, [esp+8]");
+    asmInstruction("sar eax, 2");
+    asmInstruction("push eax"); // i = index of the element found
+  }
+
+  storeValue(idiom->counterLvalue(), false, lvl);
+  _pf.TRASH(16);
+  _pf.JMP(mklbl(endLbl));
+
+  _pf.LABEL(mklbl(skipLbl));
+  _pf.TRASH(16);
+  if (fallback) {
+    _pf.JMP(mklbl(endLbl));
+    _pf.LABEL(mklbl(fallbackLbl));
+    _pf.TRASH(16);
+    generateLoop(node, lvl);
+  }
+  _pf.LABEL(mklbl(endLbl));
+  return true;
+}
+
+/*
+ * Runs the iterations of an element-wise loop (see vector_loop) 16 bytes
+ * at a time with SSE2, leaving the counter at the first iteration that
+ * did not run. The arrays, the invariants, the counter and the bound are
+ * pushed by the postfix machine and then used directly from the stack.
+ * Nothing runs when stored arrays partially overlap other arrays within
+ * 16 bytes, as the vector loads would then miss earlier stores.
+*/
+bool til::postfix_writer::vectorizeLoop(const til::counted_loop &loop, int lvl) {
+  if (!options::vectorize()) {
+    return false;
+  }
+
+  auto vector = vector_loop::recognise(loop);
+  if (!vector) {
+    return false;
+  }
+
+  for (auto index : loop.effects()->indexes()) {
+    if (needsIndexCheck(index)) {
+      return false;
+    }
+  }
+
+  // all arrays hold the same element type, int or double
+  std::optional<cdk::typename_type> element;
+  for (auto &name : vector->arrays()) {
+    auto array = _symtab.find(name);
+    if (array == nullptr || !array->is_typed(cdk::TYPE_POINTER) || _addressTaken.count(name)) {
+      return false;
+    }
+
+    auto referenced = cdk::reference_type::cast(array->type())->referenced()->name();
+    if ((referenced != cdk::TYPE_INT && referenced != cdk::TYPE_DOUBLE) || (element && *element != referenced)) {
+      return false;
+    }
+    element = referenced;
+  }
+
+  bool isDouble = element == cdk::TYPE_DOUBLE;
+  if (!isDouble && vector->hasMultiplications()) {
+    return false; // SSE2 has neither a packed 32-bit multiplication nor integer division
+  } else if (isDouble && vector->reductions() > 0 && !options::vectorizeFloatReductions()) {
+    return false;
+  } else if (vector->registers() + vector->reductions() > 8) {
+    return false;
+  }
+
+  // variables are read once, before the loop: the stores must not reach them
+  bool hasStores = !vector->storedArrays().empty();
+  auto invariantVariable = [&](const std::string &name) {
+    auto symbol = _symtab.find(name);
+    return symbol != nullptr && symbol->type()->name() == element && !_addressTaken.count(name)
+           && !(symbol->global() && hasStores);
+  };
+
+  for (auto invariant : vector->invariants()) {
+    if (auto name = counted_loop::readVariable(invariant); name && !invariantVariable(*name)) {
+      return false;
+    } else if (!isDouble && dynamic_cast<cdk::double_node*>(invariant)) {
+      return false;
+    }
+  }
+  for (auto &statement : vector->statements()) {
+    if (statement.accumulator && !invariantVariable(*counted_loop::readVariable(statement.accumulator))) {
+      return false;
+    }
+  }
+
+  // push the operands (offsets are fixed once everything is on the stack)
+  auto lineno = loop.loop()->lineno();
+  int pushed = 0;
+  std::map<std::string, int> arrays;
+  std::map<cdk::expression_node*, int> invariants;
+
+  for (auto &name : vector->arrays()) {
+    (new cdk::rvalue_node(lineno, new cdk::variable_node(lineno, name)))->accept(this, lvl);
+    arrays[name] = (pushed += 4);
+  }
+  for (auto invariant : vector->invariants()) {
+    if (auto literal = dynamic_cast<cdk::integer_node*>(invariant)) {
+      if (isDouble) _pf.DOUBLE(literal->value()); else _pf.INT(literal->value());
+    } else if (auto literal = dynamic_cast<cdk::double_node*>(invariant)) {
+      _pf.DOUBLE(literal->value());
+    } else {
+      invariant->accept(this, lvl);
+    }
+    invariants[invariant] = (pushed += isDouble ? 8 : 4);
+  }
+  for (auto &entry : arrays) entry.second = pushed - entry.second;
+  for (auto &entry : invariants) entry.second = pushed - entry.second;
+
+  dynamic_cast<cdk::binary_operation_node*>(loop.loop()->condition())->left()->accept(this, lvl);
+  loop.bound()->accept(this, lvl);
+
+  auto slot = [](int offset) { return "[esp+" + std::to_string(offset) + "]"; };
+  int lanes = isDouble ? 2 : 4;
+  int skipLbl = ++_lbl, bodyLbl = ++_lbl;
+
+  // ecx: counter; edx: number of vector iterations
+  asmInstruction("pop edx");
+  asmInstruction("pop ecx");
+  asmInstruction("cmp ecx, edx");
+  asmInstruction("jge " + mklbl(skipLbl));
+  asmInstruction("sub edx, ecx");
+  asmInstruction(std::string("shr edx, ") + (isDouble ? "1" : "2"));
+  asmInstruction("jz " + mklbl(skipLbl));
+
+  // stored arrays must coincide with, or be 16 bytes away from, the other arrays
+  for (auto &stored : vector->storedArrays()) {
+    for (auto &other : vector->arrays()) {
+      if (other == stored || (arrays[other] < arrays[stored] && std::count(vector->storedArrays().begin(),
+                                                                           vector->storedArrays().end(), other))) {
+        continue; // same variable, or pair already checked
+      }
+      int okLbl = ++_lbl;
+      asmInstruction("mov eax, " + slot(arrays[stored]));
+      asmInstruction("sub eax, " + slot(arrays[other]));
+      asmInstruction("jz " + mklbl(okLbl));
+      asmInstruction("cmp eax, -16");
+      asmInstruction("jle " + mklbl(okLbl));
+      asmInstruction("cmp eax, 16");
+      asmInstruction("jl " + mklbl(skipLbl));
+      _pf.LABEL(mklbl(okLbl));
+    }
+  }
+
+  // reductions accumulate in xmm7, xmm6, ...
+  std::vector<std::string> accumulators;
+  for (auto &statement : vector->statements()) {
+    if (statement.accumulator) {
+      accumulators.push_back("xmm" + std::to_string(7 - accumulators.size()));
+      asmInstruction((isDouble ? "xorpd " : "pxor ") + accumulators.back() + ", " + accumulators.back());
+    }
+  }
+
+  _pf.ALIGN();
+  _pf.LABEL(mklbl(bodyLbl));
+  size_t reduction = 0;
+  for (auto &statement : vector->statements()) {
+    vectorExpression(statement.value, 0, isDouble, arrays, invariants);
+    if (statement.accumulator) {
+      asmInstruction((isDouble ? "addpd " : "paddd ") + accumulators[reduction++] + ", xmm0");
+    } else {
+      asmInstruction("mov eax, " + slot(arrays[*counted_loop::readVariable(statement.target->pointer())]));
+      asmInstruction(isDouble ? "movupd [eax+ecx*8], xmm0" : "movdqu [eax+ecx*4], xmm0");
+    }
+  }
+  asmInstruction("add ecx, " + std::to_string(lanes));
+  asmInstruction("dec edx");
+  asmInstruction("jnz " + mklbl(bodyLbl));
+
+  // the counter continues where the vector loop stopped
+  asmInstruction("push ecx");
+  storeValue(dynamic_cast<cdk::assignment_node*>(loop.increment()->argument())->lvalue(), false, lvl);
+
+  // add the lanes of each accumulator (all pushed before the postfix machine touches any register)
+  for (auto &accumulator : accumulators) {
+    if (isDouble) {
+      asmInstruction("movapd xmm0, " + accumulator);
+      asmInstruction("unpckhpd xmm0, xmm0");
+      asmInstruction("addsd " + accumulator + ", xmm0");
+      asmInstruction("sub esp, 8");
+      asmInstruction("movsd qword [esp], " + accumulator);
+    } else {
+      asmInstruction("pshufd xmm0, " + accumulator + ", 0x4E");
+      asmInstruction("paddd " + accumulator + ", xmm0");
+      asmInstruction("pshufd xmm0, " + accumulator + ", 0xB1");
+      asmInstruction("paddd " + accumulator + ", xmm0");
+      asmInstruction("sub esp, 4");
+      asmInstruction("movd dword [esp], " + accumulator);
+    }
+  }
+  for (auto statement = vector->statements().rbegin(); statement != vector->statements().rend(); statement++) {
+    if (statement->accumulator) {
+      statement->accumulator->accept(this, lvl);
+      if (isDouble) _pf.DADD(); else _pf.ADD();
+      storeValue(statement->assignment->lvalue(), isDouble, lvl);
+    }
+  }
+
+  _pf.LABEL(mklbl(skipLbl));
+  _pf.TRASH(pushed);
+  return true;
+}
+
+/*
+ * Evaluates an element-wise expression for the current lanes into xmm<reg>,
+ * using the registers above it for temporaries.
+*/
+void til::postfix_writer::vectorExpression(cdk::expression_node * const node, size_t reg, bool isDouble,
+            const std::map<std::string, int> &arrays, const std::map<cdk::expression_node*, int> &invariants) {
+  auto xmm = "xmm" + std::to_string(reg);
+
+  if (auto index = dynamic_cast<til::index_node*>(node)) {
+    auto offset = arrays.at(*counted_loop::readVariable(index->pointer()));
+    asmInstruction("mov eax, [esp+" + std::to_string(offset) + "]");
+    if (isDouble) {
+      asmInstruction("movupd " + xmm + ", [eax+ecx*8]");
+    } else {
+      asmInstruction("movdqu " + xmm + ", [eax+ecx*4]");
+    }
+  } else if (auto invariant = invariants.find(node); invariant != invariants.end()) {
+    // broadcast to every lane
+    auto value = "[esp+" + std::to_string(invariant->second) + "]";
+    if (isDouble) {
+      asmInstruction("movsd " + xmm + ", qword " + value);
+      asmInstruction("unpcklpd " + xmm + ", " + xmm);
+    } else {
+      asmInstruction("movd " + xmm + ", dword " + value);
+      asmInstruction("pshufd " + xmm + ", " + xmm + ", 0");
+    }
+  } else {
+    auto operation = dynamic_cast<cdk::binary_operation_node*>(node);
+    auto right = "xmm" + std::to_string(reg + 1);
+    vectorExpression(operation->left(), reg, isDouble, arrays, invariants);
+    vectorExpression(operation->right(), reg + 1, isDouble, arrays, invariants);
+
+    std::string instruction;
+    if (isInstanceOf<cdk::add_node>(node)) {
+      instruction = isDouble ? "addpd " : "paddd ";
+    } else if (isInstanceOf<cdk::sub_node>(node)) {
+      instruction = isDouble ? "subpd " : "psubd ";
+    } else if (isInstanceOf<cdk::mul_node>(node)) {
+      instruction = "mulpd ";
+    } else {
+      instruction = "divpd ";
+    }
+    asmInstruction(instruction + xmm + ", " + right);
+  }
 }
 
 void til::postfix_writer::do_next_node(til::next_node * const node, int lvl) {
@@ -2,8 +2,14 @@
 #define __TIL_TARGETS_POSTFIX_WRITER_H__
 
 #include "targets/basic_ast_visitor.h"
+#include "targets/counted_loop.h"
+#include "targets/vector_loop.h"
+#include "targets/loop_idiom.h"
+#include "targets/constant_evaluator.h"
+#include "targets/alias_analysis.h"
 
 #include <sstream>
+#include <map>
 #include <optional>
 #include <stack>
 #include <set>
@@ -15,6 +21,57 @@ namespace til {
   //! Traverse syntax tree and generate the corresponding assembly code.
   //!
   class postfix_writer: public basic_ast_visitor {
+    static constexpr int checkedArrayTag = 0x5AFEA11C; // checked mode: marks arrays with a size header
+    static constexpr int workerStackSize = 1 << 16; // parallel loops: stack of each pool thread
+    static constexpr int cacheLineSize = 64; // prefetching: strides below this are left to the hardware
+    static constexpr const char *promotionRegisters[] = { "ebx", "esi", "edi" }; // locals kept in registers (callee-saved)
+
+    // parallel loops: fields of the thread pool's job descriptor
+    enum { POOL_GENERATION = 0, POOL_FUNCTION = 4, POOL_FRAME = 8, POOL_NEXT = 12, POOL_END = 16,
+           POOL_PENDING = 20, POOL_WORKERS = 24, POOL_STARTED = 28, POOL_THREADS = 32, POOL_SIZE = 36 };
+
+    // how a private function is called, when it differs from the usual sequence
+    struct convention {
+      std::map<std::string, constant_evaluator::constant> constants; // parameters every call passes as the same literal
+      std::vector<bool> dead; // parameters that are not passed
+      bool resultUnused; // no call uses the returned value
+    };
+
+    // an access of the innermost counted loop that is prefetched ahead
+    struct prefetch {
+      til::index_node *access;
+      til::index_node *gather; // (index b (+ i offset)) giving the index, if any
+      int offset; // of the counter, in the access or else in the gather
+      size_t size; // of the accessed elements
+    };
+
+    // while it lives, the output is thrown away: code nothing can reach is still
+    // generated (and so checked), but the helpers it brings in are forgotten
+    struct discarded_output {
+      postfix_writer &writer;
+      std::ostringstream buffer;
+      std::streambuf *output;
+      int arenaLbl, poolLbl, poolDataLbl;
+      bool arenaEmitted, poolEmitted;
+      std::set<std::string> externals;
+
+      discarded_output(postfix_writer &writer) :
+          writer(writer), output(writer._compiler->ostream()->rdbuf(buffer.rdbuf())),
+          arenaLbl(writer._arenaLbl), poolLbl(writer._poolLbl), poolDataLbl(writer._poolDataLbl),
+          arenaEmitted(writer._arenaEmitted), poolEmitted(writer._poolEmitted),
+          externals(writer._externalFunctionsToDeclare) {
+      }
+      ~discarded_output() {
+        writer._compiler->ostream()->rdbuf(output);
+        writer._arenaLbl = arenaLbl;
+        writer._poolLbl = poolLbl;
+        writer._poolDataLbl = poolDataLbl;
+        writer._arenaEmitted = arenaEmitted;
+        writer._poolEmitted = poolEmitted;
+        writer._externalFunctionsToDeclare = externals;
+      }
+    };
+
     cdk::symbol_table<til::symbol> &_symtab;
     cdk::basic_postfix_emitter &_pf;
     int _lbl;
@@ -28,6 +85,56 @@ namespace til {
     std::optional<std::string> _externalFunctionName; // name of external function to be called, if any
     std::vector<std::pair<std::string, std::string>> *_currentFunctionLoopLabels; // labels of current visiting function's loops (condition, end)
     bool _visitedFinalInstruction = false;
+    bool _valueDiscarded = false; // the next assignment or call is a statement: its value is not needed
+    std::set<std::string> _addressTaken; // variables of the current function used with ?
+    std::optional<std::pair<std::string, int>> _loopEntryValue; // constant assigned right before the next loop
+    std::map<til::index_node*, int> _derivedPointers; // indexed accesses replaced by a pointer (frame slot)
+    std::vector<std::pair<int, int>> _pointerIncrements; // pointers of the innermost counted loop (slot, bytes per iteration)
+    std::map<cdk::expression_node*, std::pair<int, int>> _pointerTests; // counter tests replaced by pointer tests (pointer slot, end slot)
+    std::set<cdk::basic_node*> _elidedInstructions; // increments of dead counters
+    std::set<til::index_node*> _uncheckedIndexes; // checked mode: accesses proven in bounds
+    int _indexFailLbl = 0; // checked mode: current function's out-of-bounds handler (0 if unused)
+    std::map<til::alloc_node*, size_t> _fixedAllocations; // allocations kept in frame slots (bytes)
+    std::vector<std::pair<size_t, int>> _stackSaves; // blocks freeing their allocations (loop depth, stack pointer slot)
+    std::set<til::alloc_node*> _heapAllocations; // heap mode: allocations that may outlive the current function
+    int _arenaLbl = 0; // heap mode: the arena allocator (0 until needed)
+    bool _arenaEmitted = false;
+    std::map<std::string, constant_evaluator::constant> _globalConstants; // initial values of numeric globals
+    std::map<std::string, constant_evaluator::constant> _immutableGlobals; // ... of those never written
+    std::map<std::string, til::function_node*> _pureFunctions; // global functions that can run at compile time
+    std::set<std::string> _moduleAssigned; // variables written (or used with ?) anywhere in the module
+    bool _moduleAnalysed = false;
+    std::map<std::string, std::map<std::vector<std::optional<constant_evaluator::constant>>, int>> _callPatterns; // literal arguments of the calls of each name, and their weight
+    std::map<std::string, std::vector<std::pair<std::map<size_t, constant_evaluator::constant>, std::string>>> _clones; // specializations of each global function (constant arguments by position, label)
+    int _specializationBudget = 0; // AST nodes left for clones
+    std::map<std::string, constant_evaluator::constant> _cloneArguments; // for the next function node: generate a clone with these parameters fixed
+    std::string _cloneOf; // ... of the function with this label
+    std::map<std::string, constant_evaluator::constant> _specializedArguments; // clone being generated: its constant parameters
+    std::string _recursionLabel; // target of @ in the current function
+    std::string _lastFunctionLabel;
+    std::map<std::string, til::function_node*> _privateFunctions; // global functions only ever called directly ...
+    std::map<til::function_node*, convention> _conventions; // ... and how they are called
+    std::set<til::declaration_node*> _deadParameters;
+    const convention *_currentConvention = nullptr; // of the function being generated
+    std::set<til::function_node*> _memoized; // functions that keep a table of their results
+    int _frameSize = 0; // locals of the current function (bytes)
+    int _argumentsSize = 0; // ... and its arguments
+    int _poolLbl = 0; // parallel loops: the thread pool's dispatcher (0 until needed)
+    int _poolDataLbl = 0; // ... and its job descriptor
+    bool _poolEmitted = false;
+    bool _inParallelLoop = false; // generating the body of a parallel loop
+    std::set<std::string> _moduleAddressTaken; // variables used with ? anywhere in the module
+    std::set<std::string> _deadGlobals; // private globals nothing reachable refers to
+    std::set<std::string> _headerlessPointers; // checked mode: variables that may point to memory without a size header
+    std::set<std::string> _assigned; // variables written by the current function
+    std::map<til::symbol*, til::alloc_node*> _allocationSites; // arrays that always hold one allocation
+    std::map<cdk::rvalue_node*, int> _hoistedLoads; // loads done before their loop (frame slot)
+    std::map<til::index_node*, int> _forwardedElements; // accesses of elements kept in a frame slot through their loop
+    std::map<std::string, std::string> _promotable; // locals of the current function kept in registers ...
+    std::map<til::symbol*, std::string> _promoted; // ... and the declarations holding them
+    const til::counted_loop *_prefetchLoop = nullptr; // loop whose body copies start with prefetches ...
+    std::vector<prefetch> _prefetches; // ... of these accesses
+    bool _functionsCompared = false; // function values are compared somewhere (code folding must keep addresses apart)
 
   public:
     postfix_writer(std::shared_ptr<cdk::compiler> compiler, cdk::symbol_table<til::symbol> &symtab,
@@ -39,15 +146,74 @@ namespace til {
     ~postfix_writer() {
       os().flush();
     }
+
+    inline bool functionsCompared() const {
+      return _functionsCompared;
+    }
   
   protected:
     void wrapFunction(int lineno, std::shared_ptr<cdk::basic_type> const node_type, cdk::expression_node * const node, int lvl);
     void acceptCovariantNode(std::shared_ptr<cdk::basic_type> const node_type, cdk::expression_node * const node, int lvl);
     void prepareIDBinaryExpression(cdk::binary_operation_node * const node, int lvl);
     void prepareIDBinaryPredicateExpression(cdk::binary_operation_node * const node, int lvl);
+    void acceptDiscarded(cdk::expression_node * const node, int lvl);
+    bool isTruthValue(cdk::expression_node * const node);
+    void acceptCondition(cdk::expression_node * const node, int lvl, const std::string &label, bool jumpIfTrue);
+    void acceptComparison(cdk::binary_operation_node * const node, int lvl, const std::string &label, bool jumpIfTrue);
+    void jumpOnComparison(cdk::expression_node * const node, const std::string &label, bool jumpIfTrue);
     template<size_t P, typename T> void executeControlLoopInstruction(T * const node);
+    std::optional<til::counted_loop> countedLoop(til::loop_node * const node);
+    bool unrollFully(const til::counted_loop &loop, std::optional<int> start, int lvl);
+    bool unrollLoop(const til::counted_loop &loop, std::optional<size_t> counterPointer, int lvl);
+    std::optional<size_t> derivePointers(const til::counted_loop &loop, int lvl);
+    void replaceCounterTest(const til::counted_loop &loop, size_t counterPointer, cdk::expression_node * const condition,
+                            cdk::expression_node * const bound, int lvl);
+    void releasePointers(const til::counted_loop &loop, std::optional<size_t> counterPointer, int lvl);
+    bool replaceIdiom(til::loop_node * const node, int lvl);
+    bool vectorizeLoop(const til::counted_loop &loop, int lvl);
+    void vectorExpression(cdk::expression_node * const node, size_t reg, bool isDouble,
+                          const std::map<std::string, int> &arrays, const std::map<cdk::expression_node*, int> &invariants);
+    std::optional<int> hoistLoads(til::loop_node * const node, std::vector<cdk::rvalue_node*> &hoisted,
+                                  std::vector<til::index_node*> &forwarded, int lvl);
+    void optimiseLoop(til::loop_node * const node, std::optional<std::pair<std::string, int>> entryValue, int lvl);
+    bool versionLoop(til::loop_node * const node, std::optional<std::pair<std::string, int>> entryValue, int lvl);
+    til::loop_node *fuseLoops(til::loop_node * const first, cdk::basic_node * const reset, cdk::basic_node * const second,
+                              std::optional<std::pair<std::string, int>> entryValue);
+    bool needsIndexCheck(til::index_node * const node);
+    void checkIndex(int pointer, int index, size_t elementSize, const std::string &failLabel);
+    void generateArena(int lineno, int lvl);
+    bool parallelizeLoop(til::loop_node * const node, std::optional<std::pair<std::string, int>> entryValue, int lvl);
+    void generateThreadPool();
+    bool pureFunction(til::function_node * const node);
+    std::optional<bool> specializedCondition(cdk::expression_node * const condition);
+    bool selectAssignment(til::if_else_node * const node, int lvl);
+    static cdk::assignment_node *singleAssignment(cdk::basic_node * const node);
+    bool dispatchChain(til::if_else_node * const node, int lvl);
+    void searchCases(const std::vector<std::pair<int, int>> &cases, size_t first, size_t last, int defaultLbl);
+    static cdk::basic_node *singleInstruction(cdk::basic_node * const node);
+    void analyseConventions(cdk::sequence_node * const module, effect_analyser &effects);
+    void findDeadGlobals(cdk::sequence_node * const module);
+    void findHeaderlessPointers(cdk::sequence_node * const module, effect_analyser &effects);
+    bool allocatedPointer(cdk::expression_node * const node);
+    bool memoizable(til::function_node * const node);
+    void memoEntry(const std::vector<int> &key, size_t entrySize, int table);
+    void specializeFunction(const std::string &name, til::function_node * const node, int lvl);
+    static std::vector<std::optional<constant_evaluator::constant>> literalArguments(til::function_call_node * const node);
+    void promoteLocals(effect_analyser &effects);
+    std::optional<std::string> promotedRegister(const std::string &name);
+    void storeValue(cdk::lvalue_node * const lvalue, bool isDouble, int lvl);
+    void spillPromoted(bool reload);
+    void planPrefetches(const til::counted_loop &loop);
+    void prefetchAhead(int lvl);
+    void generateLoop(til::loop_node * const node, int lvl);
+    void acceptLoopBody(til::loop_node * const node, int lvl);
 
   private:
+    /** Writes an instruction the postfix machine has no equivalent for. */
+    inline void asmInstruction(const std::string &instruction) {
+      os() << "\t" << instruction << std::endl;
+    }
+
     /** Method used to generate sequential labels. */
     inline std::string mklbl(int lbl) {
       std::ostringstream oss;
@@ -58,6 +224,10 @@ namespace til {
       return oss.str();
     }
 
+    inline std::string poolField(int field) {
+      return "[" + mklbl(_poolDataLbl) + "+" + std::to_string(field) + "]";
+    }
+
     inline bool inFunction() {
       return !_forceOutsideFunction && !_functionLabels.empty();
     }
@@ -0,0 +1,117 @@
+#include <algorithm>
+#include "targets/vector_loop.h"
+#include ".auto/all_nodes.h"
+
+std::optional<til::vector_loop> til::vector_loop::recognise(const counted_loop &loop) {
+  if (loop.step() != 1 || loop.inclusive() || loop.body()->declarations()->size() != 0) {
+    return std::nullopt;
+  }
+
+  vector_loop vector;
+  auto instructions = loop.body()->instructions();
+  for (size_t i = 0; i + 1 < instructions->size(); i++) {
+    auto evaluation = dynamic_cast<til::evaluation_node*>(instructions->node(i));
+    auto assignment = evaluation ? dynamic_cast<cdk::assignment_node*>(evaluation->argument()) : nullptr;
+    if (assignment == nullptr) {
+      return std::nullopt;
+    }
+
+    statement current = { assignment, nullptr, nullptr, nullptr };
+    if (auto target = dynamic_cast<til::index_node*>(assignment->lvalue())) {
+      // (set (index d i) E)
+      auto array = counted_loop::readVariable(target->pointer());
+      if (!array || *array == loop.counter() || loop.linearOffset(target->index()) != 0) {
+        return std::nullopt;
+      }
+      current.target = target;
+      current.value = assignment->rvalue();
+
+      if (std::find(vector._arrays.begin(), vector._arrays.end(), *array) == vector._arrays.end()) {
+        vector._arrays.push_back(*array);
+      }
+      if (std::find(vector._storedArrays.begin(), vector._storedArrays.end(), *array) == vector._storedArrays.end()) {
+        vector._storedArrays.push_back(*array);
+      }
+    } else if (auto var = dynamic_cast<cdk::variable_node*>(assignment->lvalue())) {
+      // (set s (+ s E)) or (set s (+ E s)), with s read nowhere else
+      auto add = dynamic_cast<cdk::add_node*>(assignment->rvalue());
+      if (add == nullptr || var->name() == loop.counter() || loop.effects()->reads(var->name()) != 1) {
+        return std::nullopt;
+      }
+
+      if (counted_loop::readVariable(add->left()) == var->name()) {
+        current.accumulator = dynamic_cast<cdk::rvalue_node*>(add->left());
+        current.value = add->right();
+      } else if (counted_loop::readVariable(add->right()) == var->name()) {
+        current.accumulator = dynamic_cast<cdk::rvalue_node*>(add->right());
+        current.value = add->left();
+      } else {
+        return std::nullopt;
+      }
+    } else {
+      return std::nullopt;
+    }
+
+    if (!vector.recogniseExpression(loop, current.value)) {
+      return std::nullopt;
+    }
+    vector._registers = std::max(vector._registers, registers(current.value));
+    vector._statements.push_back(current);
+  }
+
+  if (vector._statements.empty()) {
+    return std::nullopt;
+  }
+  return vector;
+}
+
+/*
+ * Checks that expression is an element-wise E and collects its leaves.
+*/
+bool til::vector_loop::recogniseExpression(const counted_loop &loop, cdk::expression_node *expression) {
+  if (auto index = dynamic_cast<til::index_node*>(expression)) {
+    auto array = counted_loop::readVariable(index->pointer());
+    if (!array || *array == loop.counter() || loop.linearOffset(index->index()) != 0) {
+      return false;
+    }
+    if (std::find(_arrays.begin(), _arrays.end(), *array) == _arrays.end()) {
+      _arrays.push_back(*array);
+    }
+    return true;
+  }
+
+  if (dynamic_cast<cdk::integer_node*>(expression) || dynamic_cast<cdk::double_node*>(expression)) {
+    _invariants.push_back(expression);
+    return true;
+  }
+
+  if (auto name = counted_loop::readVariable(expression)) {
+    // the counter itself would need a vector of consecutive values
+    if (*name == loop.counter() || loop.effects()->assigned().count(*name)) {
+      return false;
+    }
+    _invariants.push_back(expression);
+    return true;
+  }
+
+  if (dynamic_cast<cdk::mul_node*>(expression) || dynamic_cast<cdk::div_node*>(expression)) {
+    _hasMultiplications = true;
+  } else if (!dynamic_cast<cdk::add_node*>(expression) && !dynamic_cast<cdk::sub_node*>(expression)) {
+    return false;
+  }
+
+  auto operation = dynamic_cast<cdk::binary_operation_node*>(expression);
+  return recogniseExpression(loop, operation->left()) && recogniseExpression(loop, operation->right());
+}
+
+size_t til::vector_loop::registers(cdk::expression_node *expression) {
+  auto operation = dynamic_cast<cdk::binary_operation_node*>(expression);
+  if (operation == nullptr) {
+    return 1;
+  }
+  return std::max(registers(operation->left()), registers(operation->right()) + 1);
+}
+
+size_t til::vector_loop::reductions() const {
+  return std::count_if(_statements.begin(), _statements.end(), [](auto &s) { return s.accumulator != nullptr; });
+}
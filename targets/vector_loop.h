@@ -0,0 +1,70 @@
+#ifndef __TIL_TARGETS_VECTOR_LOOP_H__
+#define __TIL_TARGETS_VECTOR_LOOP_H__
+
+#include <optional>
+#include <string>
+#include <vector>
+#include "targets/counted_loop.h"
+
+namespace til {
+
+  /**
+   * Describes a counted loop (< i n) with step 1 whose body only applies
+   * element-wise arithmetic to arrays indexed by the counter:
+   *
+   *   (set (index d i) E)    element-wise map
+   *   (set s (+ s E))        reduction into s
+   *
+   * E combines (index a i), variables not written by the loop and literals
+   * with +, -, * and /. As every access uses the same index, iterations only
+   * interact through memory when distinct arrays overlap. Recognition is
+   * syntactic: callers still have to check types and variables.
+   */
+  class vector_loop {
+  public:
+    struct statement {
+      cdk::assignment_node *assignment;
+      cdk::expression_node *value; // E
+      til::index_node *target; // element-wise maps
+      cdk::rvalue_node *accumulator; // reductions: s in (+ s E)
+    };
+
+  private:
+    std::vector<statement> _statements;
+    std::vector<std::string> _arrays; // loaded or stored, without repetitions
+    std::vector<std::string> _storedArrays;
+    std::vector<cdk::expression_node*> _invariants; // variables and literals used in E
+    bool _hasMultiplications = false; // * or /
+    size_t _registers = 0; // registers needed by the largest E
+
+    vector_loop() {
+    }
+
+    bool recogniseExpression(const counted_loop &loop, cdk::expression_node *expression);
+
+  public:
+    static std::optional<vector_loop> recognise(const counted_loop &loop);
+
+    /** Registers needed to evaluate expression, reusing the left operand's for the result. */
+    static size_t registers(cdk::expression_node *expression);
+
+  public:
+    const std::vector<statement> &statements() const { return _statements; }
+
+    const std::vector<std::string> &arrays() const { return _arrays; }
+
+    const std::vector<std::string> &storedArrays() const { return _storedArrays; }
+
+    const std::vector<cdk::expression_node*> &invariants() const { return _invariants; }
+
+    bool hasMultiplications() const { return _hasMultiplications; }
+
+    size_t reductions() const;
+
+    size_t registers() const { return _registers; }
+
+  };
+
+} // til
+
+#endif
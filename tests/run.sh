@@ -0,0 +1,32 @@
+#!/bin/bash
+# Compiles and runs test programs and compares what they print with the
+# expected output in <name>.out, next to <name>.til. Each line of <name>.env,
+# if there is one, is an environment to build the program with as well: every
+# build must print the expected output.
+#
+#   tests/run.sh [program.til...]
+#
+# The programs default to every tests/*.til. ROOT must point to the CDK/RTS
+# installation, as in the Makefile.
+
+. "$(dirname "$0")/../bench/common.sh"
+
+failed=0
+for program in ${@:-$(dirname "$0")/*.til}; do
+  name=$(basename "$program" .til)
+  environments=("")
+  if [ -f "${program%.til}.env" ]; then
+    mapfile -t -O 1 environments < "${program%.til}.env"
+  fi
+  for environment in "${environments[@]}"; do
+    if build "$name" "$program" "$environment" \
+        && "$WORK/$name" > "$WORK/$name.txt" \
+        && diff -u "${program%.til}.out" "$WORK/$name.txt"; then
+      echo "ok:   $name (${environment:-default settings})"
+    else
+      echo "FAIL: $name (${environment:-default settings})"
+      failed=1
+    fi
+  done
+done
+exit $failed